@@ -1,7 +1,8 @@
 #ifdef __linux__
-/* for sched_getaffinity() */
+/* for sched_getaffinity() and RUSAGE_THREAD */
 #define _GNU_SOURCE
 #include <sched.h>
+#include <sys/prctl.h>
 #endif
 
 #ifdef __SSE2__
@@ -9,7 +10,9 @@
 #endif
 
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <pthread.h>
 #include <errno.h>
 #include <signal.h>
@@ -55,6 +58,33 @@
 #define USE_ARMV8   8
 #define USE_AVX    16
 
+/* GUPS: updates per round between two checks of stop_now, max number of
+ * interleaved update streams per thread, and the HPCC generator polynomial.
+ */
+#define GUPS_PER_ROUND  1024
+#define GUPS_MAX_BATCH  1024
+#define GUPS_POLY       0x0000000000000007ULL
+
+/* fault mode: page backings, ways to fault the pages in, and huge page size */
+#define BACK_4K         0
+#define BACK_THP        1
+#define BACK_HUGETLB    2
+#define BACKINGS        3
+
+#define FAULT_TOUCH     0   // write one byte per 4kB page
+#define FAULT_POPULATE  1   // MAP_POPULATE
+#define FAULT_MADVISE   2   // MADV_POPULATE_WRITE
+#define FAULT_METHODS   3
+
+#define HUGE_PAGE_SIZE  (2 * 1048576)
+
+/* shootdown mode: operations run by the unmapping thread */
+#define SHOOT_NONE      0   // reference run without any operation
+#define SHOOT_MUNMAP    1
+#define SHOOT_MPROTECT  2
+#define SHOOT_DONTNEED  3
+#define SHOOT_OPS       4
+
 struct stats {
 	unsigned long last;   // copy at interrupt time
 	unsigned long prev;   // copy of previous last
@@ -63,6 +93,8 @@ struct stats {
 	void *area;
 	size_t size;
 	size_t mask;
+	uint64_t busy;   // usec spent in the measured part (fault mode)
+	uint64_t bytes;  // bytes faulted in (fault mode)
 	pthread_t pth;   // pthread of the thread
 	int thr;
 } __attribute__((aligned(64)));
@@ -82,6 +114,16 @@ static __thread int thread_num;
 static int no_hugepages;
 static int efficiency = DEFAULT_EFFICIENCY;
 static int buswidth = -1; // disabled
+static int gups_batch;     // 0 = disabled, otherwise GUPS mode
+static int gups_atomic;    // perform atomic updates in GUPS mode
+static int gups_sweep;     // sweep table sizes up to <size> in GUPS mode
+static uint64_t *gups_table;
+static size_t gups_mask;   // in words
+static int fault_mode;     // measure page faults instead of bandwidth
+static int fault_backing;  // BACK_* for the fault mode
+static int fault_method;   // FAULT_* for the fault mode
+static int shoot_pages;    // pages per operation in shootdown mode, 0=off
+static volatile int start_now;
 
 void *(*run)(void *private);
 void set_alarm(unsigned int usec);
@@ -627,6 +669,61 @@ void *run512_armv8(void *private)
 }
 #endif
 
+/* Advances the HPCC RandomAccess generator (LFSR over GF(2) with polynomial
+ * x^63+x^2+x+1). It's cheap enough not to hide memory latency, and doesn't
+ * depend on any memory access so that updates remain independent.
+ */
+static inline uint64_t gups_next(uint64_t ran)
+{
+	return (ran << 1) ^ ((int64_t)ran < 0 ? GUPS_POLY : 0);
+}
+
+/* runs the GUPS test: random XOR updates over the table shared by all
+ * threads. <gups_batch> independent generators are advanced in turn so that
+ * up to this number of updates may be in flight, a batch of 1 being the
+ * unbatched variant. Updates are counted in ctx->rnd.
+ */
+void *run_gups(void *private)
+{
+	struct stats *ctx = private;
+	uint64_t ran[GUPS_MAX_BATCH];
+	uint64_t *table = gups_table;
+	size_t mask = gups_mask;
+	unsigned long count;
+	unsigned int loop;
+	int batch = gups_batch;
+	int j;
+
+	thread_num = ctx->thr;
+	thread_sync_startup(ctx->area, ctx->size, thread_num);
+
+	/* different non-zero seeds for all streams of all threads */
+	for (j = 0; j < batch; j++)
+		ran[j] = ((uint64_t)ctx->thr * GUPS_MAX_BATCH + j + 1) * 0x9E3779B97F4A7C15ULL;
+
+	for (count = ctx->rnd; !stop_now; ) {
+		__atomic_store_n(&ctx->rnd, count, __ATOMIC_RELEASE);
+		if (gups_atomic) {
+			for (loop = 0; loop < GUPS_PER_ROUND; loop += batch) {
+				for (j = 0; j < batch; j++) {
+					ran[j] = gups_next(ran[j]);
+					__atomic_xor_fetch(&table[ran[j] & mask], ran[j], __ATOMIC_RELAXED);
+				}
+			}
+		}
+		else {
+			for (loop = 0; loop < GUPS_PER_ROUND; loop += batch) {
+				for (j = 0; j < batch; j++) {
+					ran[j] = gups_next(ran[j]);
+					table[ran[j] & mask] ^= ran[j];
+				}
+			}
+		}
+		count += loop;
+	}
+	return NULL;
+}
+
 
 
 /*****************************************************************************
@@ -694,8 +791,15 @@ void alarm_handler(int sig)
 	if (usec < 95 * interval_usec / 100 || usec >= 105 * interval_usec / 100)
 		goto rearm;
 
-	rounds /= usec; // express it in B/us = MB/s
-	if (!skip_measures) {
+	rounds /= usec; // express it in B/us = MB/s, or updates/us in GUPS mode
+	if (!skip_measures && gups_batch) {
+		/* each line is self-describing so that looped runs may be merged */
+		printf("%llu.%03llu GUPS table=%llukB batch=%d%s\n",
+		       (unsigned long long)rounds / 1000, (unsigned long long)rounds % 1000,
+		       (unsigned long long)(gups_mask + 1) * sizeof(*gups_table) / 1024,
+		       gups_batch, gups_atomic ? " atomic" : "");
+	}
+	else if (!skip_measures) {
 		printf("%llu", (unsigned long long)rounds);
 		if (buswidth > 0 && efficiency > 0) {
 			printf(" DDR-%llu/%d @%d%%", (unsigned long long)rounds * 100ULL * 8ULL / (unsigned long long)(efficiency * buswidth), buswidth, efficiency);
@@ -747,6 +851,30 @@ static size_t mask_rounded_down(size_t size)
 	return mask >> 1;
 }
 
+/* Allocates <size> bytes aligned to a quarter of their size, and asks for
+ * huge pages unless disabled. Exits on failure.
+ */
+static void *alloc_area(size_t size)
+{
+	void *area;
+
+	if (posix_memalign(&area, size / 4, size) != 0 || !area) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+#ifdef MADV_DONTDUMP
+	madvise(area, size, MADV_DONTDUMP);
+#endif
+#ifdef MADV_HUGEPAGE
+	if (no_hugepages)
+		madvise(area, size, MADV_NOHUGEPAGE);
+	else
+		madvise(area, size, MADV_HUGEPAGE);
+#endif
+	return area;
+}
+
 /* Access aligned words of optimal size over <size> bytes for each thread.
  * Note: size is rounded down to the lower power of two, and must be at
  * least 4kB.
@@ -762,6 +890,15 @@ unsigned int random_read_over_area(size_t size)
 	if (!run)
 		return 0;
 
+	if (gups_batch) {
+		/* GUPS: <size> is the total table size, shared by all threads
+		 * which each initialize their own slice of it.
+		 */
+		gups_table = alloc_area(size);
+		gups_mask = size / sizeof(*gups_table) - 1;
+		size /= nbthreads;
+	}
+
 	/* create threads for thread 1 and above */
 	for (thr = 0; thr < nbthreads; thr++) {
 		stats[thr].size = size;
@@ -769,20 +906,11 @@ unsigned int random_read_over_area(size_t size)
 		stats[thr].thr = thr;
 		stats[thr].rnd = 0;
 
-		if (posix_memalign(&stats[thr].area, size / 4, size) != 0 || !stats[thr].area) {
-			printf("Failed to allocate memory for thread %d\n", thr);
-			exit(1);
-		}
-
-#ifdef MADV_DONTDUMP
-		madvise(stats[thr].area, size, MADV_DONTDUMP);
-#endif
-#ifdef MADV_HUGEPAGE
-		if (no_hugepages)
-			madvise(stats[thr].area, size, MADV_NOHUGEPAGE);
+		if (gups_batch)
+			stats[thr].area = (char *)gups_table + thr * size;
 		else
-			madvise(stats[thr].area, size, MADV_HUGEPAGE);
-#endif
+			stats[thr].area = alloc_area(size);
+
 		if (thr > 0 && pthread_create(&stats[thr].pth, NULL, run, &stats[thr]) < 0) {
 			fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
 			exit(1);
@@ -809,6 +937,451 @@ unsigned int random_read_over_area(size_t size)
 	return 0;
 }
 
+/* Returns the <n>th CPU modulo the number of CPUs the process may run on, or
+ * -1 if unknown.
+ */
+static int nth_cpu(int n)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) != 0 || !CPU_COUNT(&mask))
+		return -1;
+
+	n %= CPU_COUNT(&mask);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &mask) && n-- == 0)
+			return cpu;
+#endif
+	return -1;
+}
+
+/* binds the calling thread to CPU <cpu> unless negative */
+static void bind_to_cpu(int cpu)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+
+/* returns non-zero if THP is enabled for all areas and not only on request */
+static int thp_always()
+{
+	char buf[64] = "";
+	FILE *f;
+
+	f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if (!f)
+		return 0;
+	if (!fgets(buf, sizeof(buf), f))
+		*buf = 0;
+	fclose(f);
+	return strstr(buf, "[always]") != NULL;
+}
+
+/* Maps <size> bytes (a multiple of HUGE_PAGE_SIZE) with the backing <backing>,
+ * faulting them all in if <populate> is set. THP areas are aligned to the
+ * huge page size. Returns NULL on failure.
+ */
+static char *fault_map(size_t size, int backing, int populate)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	char *area, *aligned;
+
+	if (populate)
+		flags |= MAP_POPULATE;
+
+	if (backing == BACK_HUGETLB) {
+#ifdef MAP_HUGETLB
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		return area == MAP_FAILED ? NULL : area;
+#else
+		return NULL;
+#endif
+	}
+
+	if (backing == BACK_4K) {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (area == MAP_FAILED)
+			return NULL;
+#ifdef MADV_NOHUGEPAGE
+		madvise(area, size, MADV_NOHUGEPAGE);
+#endif
+		return area;
+	}
+
+	/* THP: the area is reserved first to be aligned, then populated in
+	 * place if requested. A new mapping loses any MADV_HUGEPAGE, so this
+	 * is only used when THP is enabled system-wide (see thp_always()).
+	 */
+	area = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags & ~MAP_POPULATE, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *)(((uintptr_t)area + HUGE_PAGE_SIZE - 1) & -(uintptr_t)HUGE_PAGE_SIZE);
+	if (aligned > area)
+		munmap(area, aligned - area);
+	munmap(aligned + size, area + HUGE_PAGE_SIZE - aligned);
+
+	if (populate) {
+		if (mmap(aligned, size, PROT_READ | PROT_WRITE, flags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+			munmap(aligned, size);
+			return NULL;
+		}
+		return aligned;
+	}
+
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+/* returns the number of minor faults of the calling thread */
+static unsigned long thread_minflt()
+{
+	struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &ru);
+#else
+	getrusage(RUSAGE_SELF, &ru);
+#endif
+	return ru.ru_minflt;
+}
+
+/* Repeatedly maps an area of ctx->size bytes, faults it in using
+ * fault_method, and unmaps it, until stop_now is set. The faults really taken
+ * are counted in ctx->rnd, whatever the page size obtained, the bytes faulted
+ * in ctx->bytes, and the time spent mapping and faulting them in ctx->busy.
+ * ctx->bytes is zero on failure.
+ */
+void *run_faults(void *private)
+{
+	struct stats *ctx = private;
+	size_t size = ctx->size;
+	uint64_t before, busy = 0, bytes = 0;
+	unsigned long faults = 0, flt;
+	size_t ofs;
+	char *area;
+
+	thread_num = ctx->thr;
+	bind_to_cpu(nth_cpu(ctx->thr));
+
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+	while (!start_now)
+		;
+
+	while (!stop_now) {
+		flt = thread_minflt();
+		before = rdtsc();
+		area = fault_map(size, fault_backing, fault_method == FAULT_POPULATE);
+		if (!area) {
+			bytes = 0;
+			break;
+		}
+
+		if (fault_method == FAULT_TOUCH) {
+			for (ofs = 0; ofs < size; ofs += 4096)
+				*(volatile char *)(area + ofs) = 1;
+		}
+#ifdef MADV_POPULATE_WRITE
+		else if (fault_method == FAULT_MADVISE) {
+			if (madvise(area, size, MADV_POPULATE_WRITE) != 0) {
+				munmap(area, size);
+				bytes = 0;
+				break;
+			}
+		}
+#else
+		else if (fault_method == FAULT_MADVISE) {
+			munmap(area, size);
+			bytes = 0;
+			break;
+		}
+#endif
+		busy += rdtsc() - before;
+		faults += thread_minflt() - flt;
+		bytes += size;
+		munmap(area, size);
+	}
+
+	ctx->busy = busy;
+	ctx->bytes = bytes;
+	ctx->rnd = faults;
+	return NULL;
+}
+
+/* Measures the page fault throughput for 1 to <nbthreads> threads in powers of
+ * two, each repeatedly mapping, faulting in and unmapping its own area of
+ * <size> bytes during <usec> microseconds in the same address space, for each
+ * backing and way to fault pages. Reports the aggregate number of faults per
+ * second in thousands, as counted by the kernel, and the GB/s faulted in, both
+ * summed over the threads' time spent mapping and faulting pages. Unmapping is
+ * not accounted. Huge page backings report '-' when only 4k pages were
+ * obtained. THP with MAP_POPULATE is only measured when THP is enabled
+ * system-wide, since it gets 4k pages otherwise.
+ */
+static void fault_scaling(size_t size, unsigned int usec)
+{
+	static const char *const back_names[BACKINGS] = { "4k pages", "THP", "hugetlb" };
+	static const char *const method_names[FAULT_METHODS] = { "touch", "populate", "madvise" };
+	double faults, bytes;
+	uint64_t nbflt, nbbytes;
+	int threads, thr;
+
+	for (fault_backing = 0; fault_backing < BACKINGS; fault_backing++) {
+#if defined(__linux__) && defined(PR_SET_THP_DISABLE)
+		/* MAP_POPULATE faults before any madvise(), so THP=always must be
+		 * disabled for the whole process to get 4k pages.
+		 */
+		prctl(PR_SET_THP_DISABLE, fault_backing == BACK_4K, 0, 0, 0);
+#endif
+		printf("%s%s: kfaults/s GB/s\nthreads:", fault_backing ? "\n" : "", back_names[fault_backing]);
+		for (fault_method = 0; fault_method < FAULT_METHODS; fault_method++)
+			printf("%16s ", method_names[fault_method]);
+		printf("\n");
+
+		for (threads = 1; ; threads = threads * 2 < nbthreads ? threads * 2 : nbthreads) {
+			printf("%7d:", threads);
+			for (fault_method = 0; fault_method < FAULT_METHODS; fault_method++) {
+				/* MAP_POPULATE would fault 4k pages, counted as huge ones */
+				if (fault_backing == BACK_THP && fault_method == FAULT_POPULATE && !thp_always()) {
+					printf(" %16s", "-");
+					continue;
+				}
+
+				ready_threads = 0;
+				start_now = stop_now = 0;
+
+				for (thr = 0; thr < threads; thr++) {
+					stats[thr].size = size;
+					stats[thr].thr = thr;
+					stats[thr].rnd = 0;
+					stats[thr].busy = 0;
+					stats[thr].bytes = 0;
+					if (pthread_create(&stats[thr].pth, NULL, run_faults, &stats[thr]) != 0) {
+						fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
+						exit(1);
+					}
+				}
+
+				while (__atomic_load_n(&ready_threads, __ATOMIC_ACQUIRE) != threads)
+					usleep(1000);
+
+				start_now = 1;
+				usleep(usec);
+				stop_now = 1;
+
+				faults = bytes = 0;
+				nbflt = nbbytes = 0;
+				for (thr = 0; thr < threads; thr++) {
+					pthread_join(stats[thr].pth, NULL);
+					if (!stats[thr].bytes || !stats[thr].busy)
+						break;
+					faults += stats[thr].rnd * 1000.0 / stats[thr].busy;
+					bytes += stats[thr].bytes / (double)stats[thr].busy / 1000.0;
+					nbflt += stats[thr].rnd;
+					nbbytes += stats[thr].bytes;
+				}
+
+				/* remaining threads still need to be joined */
+				if (thr < threads) {
+					for (thr++; thr < threads; thr++)
+						pthread_join(stats[thr].pth, NULL);
+					printf(" %16s", "-");
+				}
+				else if (fault_backing != BACK_4K && nbflt * 4096 >= nbbytes) {
+					/* one fault per 4k page: no huge page was obtained */
+					printf(" %16s", "-");
+				}
+				else
+					printf(" %9.1f %6.2f", faults, bytes);
+				fflush(stdout);
+			}
+			printf("\n");
+			if (threads == nbthreads)
+				break;
+		}
+	}
+}
+
+/* returns a timestamp in nanoseconds */
+static inline uint64_t now_ns()
+{
+	struct timespec tv;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec * 1000000000ULL + tv.tv_nsec;
+}
+
+/* Reads one word per page of its area in loop until stop_now is set, so that
+ * it depends on the TLB as much as possible. The number of pages read is
+ * counted in ctx->rnd and the time spent in ctx->busy.
+ */
+void *run_toucher(void *private)
+{
+	struct stats *ctx = private;
+	const char *area = ctx->area;
+	size_t size = ctx->size;
+	unsigned long pages = 0;
+	uint64_t before;
+	size_t ofs;
+
+	thread_num = ctx->thr;
+	bind_to_cpu(nth_cpu(ctx->thr + 1));
+	memset(ctx->area, 0, size);
+
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+	while (!start_now)
+		;
+
+	before = rdtsc();
+	while (!stop_now) {
+		for (ofs = 0; ofs < size; ofs += 4096)
+			asm volatile("" : : "r" (*(volatile const long *)(area + ofs)));
+		pages += size / 4096;
+	}
+	ctx->busy = rdtsc() - before;
+	ctx->rnd = pages;
+	return NULL;
+}
+
+/* Runs operation <op> on <pages> pages in loop from the calling thread during
+ * <usec> microseconds. The pages are written before each operation so that
+ * they are present in the TLB. Returns the average latency of the operation
+ * in nanoseconds, or a negative value on failure.
+ */
+static double shoot_loop(int op, int pages, unsigned int usec)
+{
+	size_t size = (size_t)pages * 4096;
+	uint64_t start, before, total = 0;
+	unsigned long count = 0;
+	char *area = NULL;
+	size_t ofs;
+
+	if (op == SHOOT_NONE) {
+		usleep(usec);
+		return 0;
+	}
+
+	if (op != SHOOT_MUNMAP) {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED)
+			return -1;
+	}
+
+	start = rdtsc();
+	do {
+		if (op == SHOOT_MUNMAP) {
+			area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (area == MAP_FAILED)
+				return -1;
+		}
+		else if (op == SHOOT_MPROTECT && mprotect(area, size, PROT_READ | PROT_WRITE) != 0)
+			break;
+
+		for (ofs = 0; ofs < size; ofs += 4096)
+			*(volatile char *)(area + ofs) = 1;
+
+		before = now_ns();
+		if (op == SHOOT_MUNMAP)
+			munmap(area, size);
+		else if (op == SHOOT_MPROTECT)
+			mprotect(area, size, PROT_READ);
+		else
+			madvise(area, size, MADV_DONTNEED);
+		total += now_ns() - before;
+		count++;
+	} while (rdtsc() - start < usec);
+
+	if (op != SHOOT_MUNMAP)
+		munmap(area, size);
+	return count ? (double)total / count : -1;
+}
+
+/* Measures the cost of TLB shootdowns for 1 to <nbthreads>-1 touching threads
+ * in powers of two, each reading its own area of <size> bytes during <usec>
+ * microseconds while the main thread repeatedly runs munmap(), mprotect() or
+ * madvise(MADV_DONTNEED) on <pages> pages of the same address space. For each
+ * operation, the average latency seen by the main thread and the throughput
+ * lost by the touching threads relative to a run without operation are
+ * reported.
+ */
+static void shoot_scaling(size_t size, unsigned int usec, int pages)
+{
+	static const char *const op_names[SHOOT_OPS] = { "none", "munmap", "mprotect", "dontneed" };
+	double rate, base = 0, lat;
+	int workers, max_workers;
+	int op, thr;
+
+	max_workers = nbthreads > 1 ? nbthreads - 1 : 1;
+	bind_to_cpu(nth_cpu(0));
+
+	for (thr = 0; thr < max_workers; thr++) {
+		stats[thr].area = alloc_area(size);
+		stats[thr].size = size;
+		stats[thr].thr = thr;
+	}
+
+	printf("%d pages per operation: reference Mpages/s, then ns per operation and loss\nworkers: %9s", pages, op_names[0]);
+	for (op = 1; op < SHOOT_OPS; op++)
+		printf(" %16s", op_names[op]);
+	printf("\n");
+
+	for (workers = 1; ; workers = workers * 2 < max_workers ? workers * 2 : max_workers) {
+		printf("%7d: ", workers);
+		for (op = 0; op < SHOOT_OPS; op++) {
+			ready_threads = 0;
+			start_now = stop_now = 0;
+
+			for (thr = 0; thr < workers; thr++) {
+				stats[thr].rnd = 0;
+				stats[thr].busy = 0;
+				if (pthread_create(&stats[thr].pth, NULL, run_toucher, &stats[thr]) != 0) {
+					fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
+					exit(1);
+				}
+			}
+
+			while (__atomic_load_n(&ready_threads, __ATOMIC_ACQUIRE) != workers)
+				usleep(1000);
+
+			start_now = 1;
+			lat = shoot_loop(op, pages, usec);
+			stop_now = 1;
+
+			rate = 0;
+			for (thr = 0; thr < workers; thr++) {
+				pthread_join(stats[thr].pth, NULL);
+				if (stats[thr].busy)
+					rate += (double)stats[thr].rnd / stats[thr].busy;
+			}
+
+			if (op == SHOOT_NONE) {
+				base = rate;
+				printf("%9.2f", base);
+			}
+			else if (lat < 0)
+				printf(" %16s", "-");
+			else
+				printf(" %9.0f %5.1f%%", lat, base > 0 ? 100.0 * (1.0 - rate / base) : 0.0);
+			fflush(stdout);
+		}
+		printf("\n");
+		if (workers == max_workers)
+			break;
+	}
+}
+
 /* return the default thread count based on the detected affinity settings. */
 int default_thread_count()
 {
@@ -826,6 +1399,7 @@ int main(int argc, char **argv)
 	unsigned int usec;
 	size_t size, size_thr;
 	int implementation __attribute__((unused));
+	pid_t pid;
 
 	/* set default implementation bits */
 	implementation = USE_GENERIC;
@@ -871,6 +1445,23 @@ int main(int argc, char **argv)
 			efficiency = atoi(argv[2]);
 			argc--; argv++;
 		}
+		else if (strcmp(argv[1], "-U") == 0 && argc > 2) {
+			gups_batch = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-a") == 0) {
+			gups_atomic = 1;
+		}
+		else if (strcmp(argv[1], "-W") == 0) {
+			gups_sweep = 1;
+		}
+		else if (strcmp(argv[1], "-F") == 0) {
+			fault_mode = 1;
+		}
+		else if (strcmp(argv[1], "-X") == 0 && argc > 2) {
+			shoot_pages = atoi(argv[2]);
+			argc--; argv++;
+		}
 		else if (strcmp(argv[1], "-G") == 0) {
 			implementation = USE_GENERIC;
 		}
@@ -909,6 +1500,17 @@ int main(int argc, char **argv)
 #ifdef MADV_HUGEPAGE
 				"  -H : disable Huge Pages when supported\n"
 #endif
+				"  -U <batch> : GUPS mode: random updates over a table of <size> shared by all\n"
+				"               threads, <batch> streams in flight per thread (1=unbatched)\n"
+				"  -a : use atomic updates in GUPS mode\n"
+				"  -W : GUPS mode: sweep table sizes from 64kB up to <size>, doubling\n"
+				"  -F : fault mode: page faults/s for 1..<threads> threads each faulting in\n"
+				"       its own <size>/<threads> area with 4k, THP and hugetlb pages, by\n"
+				"       touching, MAP_POPULATE or MADV_POPULATE_WRITE (THP with MAP_POPULATE\n"
+				"       needs THP enabled=always)\n"
+				"  -X <pages> : shootdown mode: latency of munmap/mprotect/madvise on <pages>\n"
+				"       pages and throughput lost by 1..<threads>-1 threads reading their\n"
+				"       own <size>/<threads> area meanwhile\n"
 				"  -h : show this help\n"
 				"  -G : use generic code only\n"
 #ifdef __SSE2__
@@ -942,10 +1544,10 @@ int main(int argc, char **argv)
 		meas_count = atoi(argv[2]);
 
 	if (argc > 3)
-		size = atol(argv[3]) * 1024;
+		size = (size_t)strtoull(argv[3], NULL, 0) * 1024;
 
 	if (!size)
-		size = nbthreads * 16 * 1048576;
+		size = (size_t)nbthreads * 16 * 1048576;
 
 	run = run512_generic;
 
@@ -985,6 +1587,70 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (shoot_pages) {
+		if (shoot_pages < 0) {
+			fprintf(stderr, "Fatal: invalid number of pages per operation.\n");
+			exit(1);
+		}
+
+		size_thr = mask_rounded_down(size / nbthreads) + 1;
+		if (size_thr < 4096) {
+			fprintf(stderr, "Fatal: too small area size, minimum is 4kB per thread\n");
+			exit(1);
+		}
+		shoot_scaling(size_thr, usec, shoot_pages);
+		exit(0);
+	}
+
+	if (fault_mode) {
+		/* whole huge pages per thread so that all backings compare */
+		size_thr = (size / nbthreads + HUGE_PAGE_SIZE - 1) & -(size_t)HUGE_PAGE_SIZE;
+		if (!size_thr)
+			size_thr = HUGE_PAGE_SIZE;
+		fault_scaling(size_thr, usec);
+		exit(0);
+	}
+
+	if (gups_batch) {
+		if (gups_batch < 1 || gups_batch > GUPS_MAX_BATCH) {
+			fprintf(stderr, "Fatal: invalid GUPS batch size, accepted range is 1..%d.\n", GUPS_MAX_BATCH);
+			exit(1);
+		}
+
+		/* the table is shared, round it down to the largest power of 2 */
+		while (size & (size - 1))
+			size = size & (size - 1);
+
+		if (size < (size_t)nbthreads * 1024) {
+			fprintf(stderr, "Fatal: too small table size, minimum is 1kB per thread\n");
+			exit(1);
+		}
+		run = run_gups;
+		if (gups_sweep) {
+			/* threads are never stopped nor joined, so each size runs
+			 * in its own process.
+			 */
+			for (size_thr = 65536; size_thr <= size; size_thr *= 2) {
+				if (size_thr < (size_t)nbthreads * 1024)
+					continue;
+				fflush(stdout);
+				pid = fork();
+				if (pid < 0) {
+					fprintf(stderr, "Failed to fork; aborting.\n");
+					exit(1);
+				}
+				if (pid == 0) {
+					random_read_over_area(size_thr);
+					exit(0);
+				}
+				waitpid(pid, NULL, 0);
+			}
+			exit(0);
+		}
+		random_read_over_area(size);
+		exit(0);
+	}
+
 	size_thr = size / nbthreads;
 
 	/* round it down to the largest power of 2 */
@@ -997,8 +1663,8 @@ int main(int argc, char **argv)
 	}
 
 	if (size_thr * nbthreads != size)
-		fprintf(stderr, "Notice: using %lu bytes per thread (%lu kB total)\n",
-			(unsigned long)size_thr, (unsigned long)(size_thr * nbthreads) / 1024);
+		fprintf(stderr, "Notice: using %llu bytes per thread (%llu kB total)\n",
+			(unsigned long long)size_thr, (unsigned long long)(size_thr * nbthreads) / 1024);
 
 	random_read_over_area(size_thr);
 	exit(0);
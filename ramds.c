@@ -0,0 +1,779 @@
+#ifdef __linux__
+/* for sched_getaffinity() */
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define MAX_THREADS 1024
+
+/* number of lookups performed between two checks of the stop flag */
+#define LOOKUPS_PER_BATCH 64
+
+/* number of nodes visited by a single list lookup */
+#define LIST_STEPS 64
+
+/* highest level of skiplist nodes */
+#define SKIP_LEVELS 32
+
+/* slot of the open-addressing hash table, key 0 is an empty slot */
+struct hslot {
+	uint64_t key;
+	uint64_t val;
+};
+
+/* skiplist node, <next> has <height> entries */
+struct snode {
+	uint64_t key;
+	uint64_t height;
+	struct snode *next[];
+};
+
+/* list node, one cache line */
+struct lnode {
+	struct lnode *next;
+	uint64_t key;
+	uint64_t pad[6];
+};
+
+/* One data structure to test. <build> creates it with a footprint of about
+ * <size> bytes, and <lookup> performs <count> lookups of random keys using the
+ * random generator at <rng>, and returns a value depending on the results so
+ * that they cannot be optimized away.
+ */
+struct test_ds {
+	const char *name;
+	void (*build)(struct test_ds *t, size_t size);
+	uint64_t (*lookup)(const struct test_ds *t, uint64_t *rng, unsigned int count);
+	void *area;      // allocated area
+	size_t size;     // allocated size
+	void *root;      // hash table, B+tree root, skiplist head, first list node
+	uint64_t nkeys;  // number of keys (or nodes for lists)
+	uint64_t mask;   // hash table mask
+	int levels;      // B+tree or skiplist levels
+};
+
+/* per-thread context */
+struct thread_ctx {
+	uint64_t lookups;   // lookups performed
+	uint64_t rng;       // random generator state
+	uint64_t sink;      // result of lookups
+	struct test_ds *test;
+	pthread_t pth;
+	int cpu;            // CPU to bind to, or -1
+	int thr;
+} __attribute__((aligned(64)));
+
+static struct thread_ctx threads[MAX_THREADS];
+
+/* set once the end is reached, reset when setting an alarm */
+static volatile int stop_now;
+static volatile int start_now;
+static int ready_threads;
+static int nbthreads;
+static int no_hugepages;
+static int fanout = 16;
+
+void set_alarm(unsigned int usec);
+
+/*****************************************************************************
+ *                                  helpers                                  *
+ *****************************************************************************/
+
+/* returns a timestamp in microseconds */
+static inline uint64_t rdtsc()
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return (tv.tv_sec * 1000000000ULL + tv.tv_nsec) / 1000ULL;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+#endif
+}
+
+/* xorshift64* random generator, state must not be zero */
+static inline uint64_t rnd64(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* returns a random value between 0 and <n>-1 */
+static inline uint64_t rnd_below(uint64_t *state, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+	return (uint64_t)(((unsigned __int128)rnd64(state) * n) >> 64);
+#else
+	return rnd64(state) % n;
+#endif
+}
+
+/* bijective 64-bit mixing function (murmur3 finalizer), only 0 maps to 0 */
+static inline uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static inline uint64_t rbit64(uint64_t x)
+{
+#ifdef __aarch64__
+	asm volatile("rbit %0, %1\n" : "=r"(x) : "r"(x));
+#else
+#if defined(__x86_64__)
+	__asm__("bswap %0" : "=r"(x) : "0"(x));
+#else
+	x = ((x & 0xffffffff00000000) >> 32) | ((x & 0x00000000ffffffff) << 32);
+	x = ((x & 0xffff0000ffff0000) >> 16) | ((x & 0x0000ffff0000ffff) << 16);
+	x = ((x & 0xff00ff00ff00ff00) >>  8) | ((x & 0x00ff00ff00ff00ff) <<  8);
+#endif
+	x = ((x & 0xf0f0f0f0f0f0f0f0) >>  4) | ((x & 0x0f0f0f0f0f0f0f0f) <<  4);
+	x = ((x & 0xcccccccccccccccc) >>  2) | ((x & 0x3333333333333333) <<  2);
+	x = ((x & 0xaaaaaaaaaaaaaaaa) >>  1) | ((x & 0x5555555555555555) <<  1);
+#endif
+	return x;
+}
+
+/* Allocates and clears an area of <size> bytes, using huge pages unless
+ * disabled. Exits on failure.
+ */
+static void *alloc_area(size_t size)
+{
+	void *area;
+
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+#ifdef MADV_DONTDUMP
+	madvise(area, size, MADV_DONTDUMP);
+#endif
+#ifdef MADV_HUGEPAGE
+	if (no_hugepages)
+		madvise(area, size, MADV_NOHUGEPAGE);
+	else
+		madvise(area, size, MADV_HUGEPAGE);
+#endif
+	memset(area, 0, size);
+	return area;
+}
+
+/*****************************************************************************
+ *                         open-addressing hash table                        *
+ *****************************************************************************/
+
+/* Builds a linear-probing hash table of 16-byte slots filled at 50% with the
+ * non-zero keys mix64(1..N).
+ */
+static void build_hash(struct test_ds *t, size_t size)
+{
+	struct hslot *tbl;
+	uint64_t slots, i, key, idx;
+
+	for (slots = 1; slots * 2 * sizeof(*tbl) <= size; slots *= 2)
+		;
+
+	t->size = slots * sizeof(*tbl);
+	t->area = t->root = tbl = alloc_area(t->size);
+	t->mask = slots - 1;
+	t->nkeys = slots / 2;
+
+	for (i = 0; i < t->nkeys; i++) {
+		key = mix64(i + 1);
+		for (idx = key & t->mask; tbl[idx].key; idx = (idx + 1) & t->mask)
+			;
+		tbl[idx].key = key;
+		tbl[idx].val = i;
+	}
+}
+
+static uint64_t lookup_hash(const struct test_ds *t, uint64_t *rng, unsigned int count)
+{
+	const struct hslot *tbl = t->root;
+	uint64_t mask = t->mask;
+	uint64_t key, idx, sum = 0;
+
+	while (count--) {
+		key = mix64(rnd_below(rng, t->nkeys) + 1);
+		for (idx = key & mask; tbl[idx].key; idx = (idx + 1) & mask) {
+			if (tbl[idx].key == key) {
+				sum += tbl[idx].val;
+				break;
+			}
+		}
+	}
+	return sum;
+}
+
+/*****************************************************************************
+ *                                   B+tree                                  *
+ *****************************************************************************/
+
+/* Nodes are arrays of 64-bit words: the number of keys, then <fanout> keys,
+ * then <fanout> children (internal nodes) or values (leaves). Internal keys
+ * are the lowest key of each child. Keys are the odd numbers 2*i+1, and nodes
+ * are allocated level by level starting from the leaves.
+ */
+static size_t bnode_size()
+{
+	return ((1 + 2 * fanout) * sizeof(uint64_t) + 63) & -64;
+}
+
+static void build_btree(struct test_ds *t, size_t size)
+{
+	size_t nsize = bnode_size();
+	uint64_t nodes, level_nodes, prev_nodes, i, j;
+	uint64_t *node, *prev, *child;
+
+	/* count the leaves that fit, including the upper levels */
+	level_nodes = size / nsize * (fanout - 1) / fanout;
+	if (level_nodes < 1)
+		level_nodes = 1;
+	t->nkeys = level_nodes * fanout;
+
+	for (nodes = 0, i = level_nodes; ; i = (i + fanout - 1) / fanout) {
+		nodes += i;
+		if (i == 1)
+			break;
+	}
+
+	t->size = nodes * nsize;
+	t->area = alloc_area(t->size);
+
+	/* leaves */
+	node = t->area;
+	for (i = 0; i < t->nkeys; i++) {
+		j = i % fanout;
+		node[1 + j] = 2 * i + 1;
+		node[1 + fanout + j] = i;
+		node[0]++;
+		if (j == fanout - 1)
+			node += nsize / sizeof(*node);
+	}
+
+	/* internal levels */
+	prev = t->area;
+	prev_nodes = level_nodes;
+	t->levels = 1;
+	while (prev_nodes > 1) {
+		node = prev + prev_nodes * nsize / sizeof(*node);
+		level_nodes = (prev_nodes + fanout - 1) / fanout;
+		for (i = 0; i < prev_nodes; i++) {
+			child = prev + i * nsize / sizeof(*node);
+			j = i % fanout;
+			node[1 + j] = child[1];
+			node[1 + fanout + j] = (uintptr_t)child;
+			node[0]++;
+			if (j == fanout - 1)
+				node += nsize / sizeof(*node);
+		}
+		prev += prev_nodes * nsize / sizeof(*node);
+		prev_nodes = level_nodes;
+		t->levels++;
+	}
+	t->root = prev;
+}
+
+static uint64_t lookup_btree(const struct test_ds *t, uint64_t *rng, unsigned int count)
+{
+	const uint64_t *node;
+	uint64_t key, n, pos, j, sum = 0;
+	int lvl;
+
+	while (count--) {
+		key = 2 * rnd_below(rng, t->nkeys) + 1;
+		node = t->root;
+		for (lvl = t->levels; lvl > 1; lvl--) {
+			/* count the children starting at or below the key */
+			for (n = node[0], pos = 0, j = 1; j < n; j++)
+				pos += node[1 + j] <= key;
+			node = (const uint64_t *)(uintptr_t)node[1 + fanout + pos];
+		}
+		for (n = node[0], j = 0; j < n; j++) {
+			if (node[1 + j] == key) {
+				sum += node[1 + fanout + j];
+				break;
+			}
+		}
+	}
+	return sum;
+}
+
+/*****************************************************************************
+ *                                  skiplist                                 *
+ *****************************************************************************/
+
+/* Builds a skiplist of keys 2*i+1 with heights drawn with p=1/2. Nodes are
+ * allocated in a scattered insertion order, as when keys arrive randomly.
+ */
+static void build_skiplist(struct test_ds *t, size_t size)
+{
+	struct snode *last[SKIP_LEVELS];
+	struct snode **nodes, *head, *node;
+	uint8_t *heights;
+	uint64_t rng = 0x1234567887654321ULL;
+	uint64_t i, rank, total, step, a, b, r;
+	int h, lvl;
+
+	/* average node size is 16 bytes plus 2 pointers */
+	t->nkeys = size / (16 + 2 * sizeof(void *));
+	if (t->nkeys < 1)
+		t->nkeys = 1;
+
+	heights = malloc(t->nkeys);
+	nodes = malloc(t->nkeys * sizeof(*nodes));
+	if (!heights || !nodes) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+	total = sizeof(*head) + SKIP_LEVELS * sizeof(void *);
+	for (i = 0; i < t->nkeys; i++) {
+		for (h = 1; h < SKIP_LEVELS && (rnd64(&rng) & 1); h++)
+			;
+		heights[i] = h;
+		total += sizeof(*node) + h * sizeof(void *);
+	}
+
+	t->size = total;
+	t->area = alloc_area(t->size);
+
+	head = t->area;
+	head->height = SKIP_LEVELS;
+	/* ranks advance by a step coprime with the count, making a full cycle.
+	 * They are accumulated modulo the count to avoid overflows.
+	 */
+	for (step = 2654435761ULL % t->nkeys; ; step++) {
+		for (a = step, b = t->nkeys; b; ) {
+			r = a % b;
+			a = b; b = r;
+		}
+		if (a == 1)
+			break;
+	}
+
+	node = (void *)&head->next[SKIP_LEVELS];
+	for (i = rank = 0; i < t->nkeys; i++) {
+		if (i)
+			rank = rank + step >= t->nkeys ? rank + step - t->nkeys : rank + step;
+		node->key = 2 * rank + 1;
+		node->height = heights[rank];
+		nodes[rank] = node;
+		node = (void *)&node->next[node->height];
+	}
+
+	/* link all nodes in key order */
+	for (lvl = 0; lvl < SKIP_LEVELS; lvl++)
+		last[lvl] = head;
+
+	t->levels = 1;
+	for (rank = 0; rank < t->nkeys; rank++) {
+		node = nodes[rank];
+		for (lvl = 0; lvl < node->height; lvl++) {
+			last[lvl]->next[lvl] = node;
+			last[lvl] = node;
+		}
+		if (node->height > t->levels)
+			t->levels = node->height;
+	}
+
+	t->root = head;
+	free(nodes);
+	free(heights);
+}
+
+static uint64_t lookup_skiplist(const struct test_ds *t, uint64_t *rng, unsigned int count)
+{
+	const struct snode *x, *y;
+	uint64_t key, sum = 0;
+	int lvl;
+
+	while (count--) {
+		key = 2 * rnd_below(rng, t->nkeys) + 1;
+		x = t->root;
+		for (lvl = t->levels - 1; lvl >= 0; lvl--) {
+			while ((y = x->next[lvl]) && y->key < key)
+				x = y;
+		}
+		y = x->next[0];
+		if (y && y->key == key)
+			sum += y->key;
+	}
+	return sum;
+}
+
+/*****************************************************************************
+ *                                linked lists                               *
+ *****************************************************************************/
+
+/* Builds a circular list of 64-byte nodes linked in allocation order */
+static void build_list_alloc(struct test_ds *t, size_t size)
+{
+	struct lnode *nodes;
+	uint64_t i;
+
+	t->nkeys = size / sizeof(*nodes);
+	if (t->nkeys < 1)
+		t->nkeys = 1;
+
+	t->size = t->nkeys * sizeof(*nodes);
+	t->area = t->root = nodes = alloc_area(t->size);
+
+	for (i = 0; i < t->nkeys; i++) {
+		nodes[i].key = i;
+		nodes[i].next = &nodes[(i + 1) % t->nkeys];
+	}
+}
+
+/* Builds a circular list of 64-byte nodes linked in bit-reversed order, which
+ * is what happens after many random insertions and deletions. The number of
+ * nodes is rounded down to a power of two.
+ */
+static void build_list_rand(struct test_ds *t, size_t size)
+{
+	struct lnode *nodes;
+	uint64_t i, next;
+	int bits;
+
+	for (t->nkeys = 1; t->nkeys * 2 * sizeof(*nodes) <= size; t->nkeys *= 2)
+		;
+	for (bits = 0; t->nkeys >> bits > 1; bits++)
+		;
+
+	t->size = t->nkeys * sizeof(*nodes);
+	t->area = t->root = nodes = alloc_area(t->size);
+
+	for (i = 0; i < t->nkeys; i++) {
+		next = bits ? rbit64(rbit64(i << (64 - bits)) + 1) >> (64 - bits) : 0;
+		nodes[i].key = i;
+		nodes[i].next = &nodes[next];
+	}
+}
+
+/* a lookup walks LIST_STEPS nodes from a random one */
+static uint64_t lookup_list(const struct test_ds *t, uint64_t *rng, unsigned int count)
+{
+	const struct lnode *nodes = t->root;
+	const struct lnode *node;
+	uint64_t sum = 0;
+	int step;
+
+	while (count--) {
+		node = &nodes[rnd_below(rng, t->nkeys)];
+		for (step = 0; step < LIST_STEPS; step++)
+			node = node->next;
+		sum += node->key;
+	}
+	return sum;
+}
+
+static struct test_ds tests[] = {
+	{ "hash",   build_hash,       lookup_hash     },
+	{ "btree",  build_btree,      lookup_btree    },
+	{ "skip",   build_skiplist,   lookup_skiplist },
+	{ "list-a", build_list_alloc, lookup_list     },
+	{ "list-r", build_list_rand,  lookup_list     },
+	{ NULL, }
+};
+
+/*****************************************************************************
+ *                                 measurements                              *
+ *****************************************************************************/
+
+/* just marks the alarm as received */
+void alarm_handler(int sig)
+{
+	stop_now = 1;
+}
+
+/* sets an alarm to trigger after <usec> microseconds. 0 disables it */
+void set_alarm(unsigned int usec)
+{
+	struct itimerval timer = {
+		.it_value.tv_usec = usec % 1000000,
+		.it_value.tv_sec  = usec / 1000000,
+	};
+
+	if (usec) {
+		stop_now = 0;
+		signal(SIGALRM, alarm_handler);
+	}
+	setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/* Binds the calling thread to CPU <cpu> if not negative, reports the thread
+ * as ready, waits for the start signal then performs lookups in batches until
+ * stopped.
+ */
+void *run_lookups(void *private)
+{
+	struct thread_ctx *ctx = private;
+	const struct test_ds *test = ctx->test;
+	uint64_t lookups = 0, sink = 0;
+	uint64_t rng = ctx->rng;
+
+#if defined(__linux__) && defined(CPU_COUNT)
+	if (ctx->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(ctx->cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+#endif
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+
+	while (!start_now)
+		;
+
+	while (!stop_now) {
+		sink += test->lookup(test, &rng, LOOKUPS_PER_BATCH);
+		lookups += LOOKUPS_PER_BATCH;
+	}
+
+	ctx->lookups = lookups;
+	ctx->sink = sink;
+	return NULL;
+}
+
+/* Runs lookups on test <test> from <nbthr> threads for about <usec>
+ * microseconds, the calling thread being the first one. Threads are bound to
+ * the CPUs listed in <cpus> if not NULL. Returns the total number of lookups
+ * per millisecond.
+ */
+static uint64_t measure(struct test_ds *test, int nbthr, unsigned int usec, const int *cpus)
+{
+	uint64_t before, after, total;
+	int thr;
+
+	ready_threads = 0;
+	start_now = 0;
+	stop_now = 0;
+
+	for (thr = 0; thr < nbthr; thr++) {
+		threads[thr].thr = thr;
+		threads[thr].test = test;
+		threads[thr].lookups = 0;
+		threads[thr].rng = mix64(thr + 1);
+		threads[thr].cpu = cpus ? cpus[thr] : -1;
+		if (thr > 0 && pthread_create(&threads[thr].pth, NULL, run_lookups, &threads[thr]) != 0) {
+			fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
+			exit(1);
+		}
+	}
+
+	/* wait for all other threads to be started */
+	while (__atomic_load_n(&ready_threads, __ATOMIC_ACQUIRE) != nbthr - 1)
+		;
+
+	set_alarm(usec);
+	after = rdtsc();
+	before = rdtsc();
+	before += before - after; // compensate for the syscall time
+	start_now = 1;
+
+	run_lookups(&threads[0]);
+
+	after = rdtsc();
+	set_alarm(0);
+
+	for (total = thr = 0; thr < nbthr; thr++) {
+		if (thr > 0)
+			pthread_join(threads[thr].pth, NULL);
+		total += threads[thr].lookups;
+	}
+
+	usec = after - before;
+	if (usec < 1)
+		usec = 1;
+	return total * 1000ULL / usec;
+}
+
+/* return the default thread count based on the detected affinity settings. */
+int default_thread_count()
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+		return CPU_COUNT(&mask);
+#endif
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	static int cpus[MAX_THREADS];
+	unsigned int usec;
+	unsigned int cols = 0;
+	uint64_t ret;
+	size_t size;
+	int *cpu_list = NULL;
+	int quiet = 0;
+	int fmt = 0;
+	int nbthr, fct;
+
+	usec = 100000;
+	size = 64 * 1048576;
+	nbthreads = default_thread_count();
+
+	while (argc > 1 && *argv[1] == '-') {
+		if (strcmp(argv[1], "-q") == 0) {
+			quiet = 1;
+		}
+		else if (strcmp(argv[1], "-n") == 0) {
+			fmt = 2;
+		}
+		else if (strcmp(argv[1], "-H") == 0) {
+			no_hugepages = 1;
+		}
+		else if (strcmp(argv[1], "-t") == 0 && argc > 2) {
+			nbthreads = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-f") == 0 && argc > 2) {
+			fanout = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+			/* -c col[,...] */
+			char *next = argv[2];
+			char *end;
+			int col;
+
+			while (*next) {
+				col = strtol(next, &end, 0);
+				if (!col || (*end != '\0' && *end != ','))
+					break;
+				cols |= 1 << (col - 1);
+				if (*end == ',')
+					end++;
+				next = end;
+			}
+			argc--; argv++;
+		}
+		else {
+			fprintf(stderr,
+				"Usage: prog [options]* [<time_ms> [<size_kB>]]\n"
+				"  -c <cols>    only run these structures (1..N, ...)\n"
+				"  -f <fanout>  B+tree fanout (def: 16)\n"
+#ifdef MADV_HUGEPAGE
+				"  -H           disable Huge Pages when supported\n"
+#endif
+				"  -n           report nanoseconds per lookup per thread\n"
+				"  -q           quiet : don't show column headers\n"
+				"  -t <threads> run with 1, 2, 4 ... up to this number of threads (def: %d)\n"
+				"  -h           show this help\n"
+				"Structures: 1=hash (open addressing, 50%% full), 2=btree (B+tree),\n"
+				"  3=skip (skiplist), 4=list-a (list in allocation order),\n"
+				"  5=list-r (list in random order). A list lookup walks %d nodes.\n"
+				"Defaults: time=100ms, size=64MB per structure, output in lookups/ms\n",
+				default_thread_count(), LIST_STEPS);
+			exit(!!strcmp(argv[1], "-h"));
+		}
+		argc--;
+		argv++;
+	}
+
+	if (argc > 1)
+		usec = atoi(argv[1]) * 1000;
+
+	if (argc > 2)
+		size = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+	if (nbthreads < 1 || nbthreads > MAX_THREADS) {
+		fprintf(stderr, "Fatal: invalid number of threads, accepted range is 1..%d.\n", MAX_THREADS);
+		exit(1);
+	}
+
+	if (fanout < 4 || fanout > 256) {
+		fprintf(stderr, "Fatal: invalid fanout, accepted range is 4..256.\n");
+		exit(1);
+	}
+
+	if (size < 4096) {
+		fprintf(stderr, "Fatal: too small area size, minimum is 4kB\n");
+		exit(1);
+	}
+
+#if defined(__linux__) && defined(CPU_COUNT)
+	{
+		cpu_set_t mask;
+		int cpu;
+
+		/* bind threads to allowed CPUs in turn */
+		if (sched_getaffinity(0, sizeof(mask), &mask) == 0 && CPU_COUNT(&mask) > 0) {
+			for (nbthr = 0; nbthr < nbthreads; ) {
+				for (cpu = 0; cpu < CPU_SETSIZE && nbthr < nbthreads; cpu++) {
+					if (CPU_ISSET(cpu, &mask))
+						cpus[nbthr++] = cpu;
+				}
+			}
+			cpu_list = cpus;
+		}
+	}
+#endif
+
+	for (fct = 0; tests[fct].name; fct++) {
+		if (cols && !(cols & (1 << fct)))
+			continue;
+		tests[fct].build(&tests[fct], size);
+	}
+
+	if (!quiet) {
+		printf("threads");
+		for (fct = 0; tests[fct].name; fct++) {
+			if (cols && !(cols & (1 << fct)))
+				continue;
+			printf("%9s", tests[fct].name);
+		}
+		printf("\n");
+	}
+
+	/* powers of two, then the requested count */
+	for (nbthr = 1; ; nbthr *= 2) {
+		if (nbthr > nbthreads)
+			nbthr = nbthreads;
+		printf("%7d", nbthr);
+		for (fct = 0; tests[fct].name; fct++) {
+			if (cols && !(cols & (1 << fct)))
+				continue;
+			ret = measure(&tests[fct], nbthr, usec, cpu_list);
+			if (fmt == 2)
+				printf("%9.1f", ret ? nbthr * 1000000.0 / ret : 0.0);
+			else
+				printf("%9llu", (unsigned long long)ret);
+			fflush(stdout);
+		}
+		printf("\n");
+		if (nbthr == nbthreads)
+			break;
+	}
+
+	exit(0);
+}
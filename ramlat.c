@@ -1,3 +1,18 @@
+#ifdef __linux__
+/* for sched_setaffinity() */
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#ifdef __SSE2__
+#include <x86intrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <signal.h>
@@ -10,6 +25,50 @@
 
 #define LOOPS_PER_ROUND 1048576
 
+/* number of slices a measure is split into in dirty mode, and min duration */
+#define DIRTY_SLICES     16
+#define DIRTY_MIN_SLICE  1000
+
+/* objects are much longer to read than words, so fewer are read per round.
+ * The rates returned by walk_area() must be divided by OBJ_ROUND_RATIO.
+ */
+#define OBJ_ROUND_RATIO 256
+#define OBJ_LOOPS_PER_ROUND (LOOPS_PER_ROUND / OBJ_ROUND_RATIO)
+
+/* lookups performed per round by the latency hiding tests, each made of 1 to
+ * LK_MAX_HOPS dependent reads. The rates returned by walk_area() must be
+ * divided by LK_ROUND_RATIO.
+ */
+#define LK_PER_ROUND 4096
+#define LK_ROUND_RATIO (LOOPS_PER_ROUND / LK_PER_ROUND)
+#define LK_MAX_HOPS 15
+#define LK_MAX_WIDTH 64
+
+/* gathers read the table at the GT_IDX indexes of gt_idx[], which is visited
+ * once per round, so that the rates returned by walk_area() are directly the
+ * number of words read. Indexes are built according to one distribution.
+ */
+#define GT_IDX LOOPS_PER_ROUND
+#define GT_UNI  0   // uniformly random over the whole table
+#define GT_SEQ  1   // sequential
+#define GT_PAGE 2   // random within a random 4kB page for each group of 64
+#define GT_SKEW 3   // random within a random power of 2 fraction of the table
+
+/* cold accesses: max number of accesses timed after each flush, max number of
+ * trials per method, and size of the buffer read to evict caches and TLBs.
+ */
+#define COLD_MAX        256
+#define COLD_MAX_TRIALS 1024
+#define COLD_EVICT_SIZE (128 * 1048576)
+
+/* hiccups: max number of stalls recorded, and of stalls and periods listed */
+#define HICCUP_MAX      1048576
+#define HICCUP_TOP      16
+#define HICCUP_PERIODS  3
+
+/* largest power of two area size supported */
+#define MAX_SIZE_BITS ((int)(8 * sizeof(size_t)) - 2)
+
 /* set once the end is reached, reset when setting an alarm */
 static volatile int stop_now;
 
@@ -19,8 +78,68 @@ static volatile int stop_now;
  * The 3rd word (bits 16 to 24), indicates how many extra parallel
  * words are read at once.
  */
-static unsigned int (*run[10])(void *area);
-static const char *name[10];
+static unsigned int (*run[16])(void *area);
+static const char *name[16];
+
+/* when set, the whole area is rewritten before each slice of a measure */
+static int dirty_first;
+
+/* size of the area to dirty in walk_area(), only set for the main table */
+static size_t dirty_size;
+
+/* distance in bytes from the current pointer to the one to prefetch */
+static long pf_ofs;
+
+/* size in bytes of the objects read at each hop by run_obj() */
+static size_t obj_size;
+
+/* the lookups for the latency hiding tests: start pointer and number of hops,
+ * as well as the number of lookups processed in parallel.
+ */
+static void **lk_start[LK_PER_ROUND];
+static unsigned char lk_hops[LK_PER_ROUND];
+static unsigned int lk_width;
+
+/* indexes of the 64-bit words read by the gather tests */
+static uint32_t *gt_idx;
+
+/* the split access tests read the 64-bit words of the slots located every
+ * <split_stride> bytes from <split_base> over <split_mask>+1 bytes. The words
+ * are not necessarily aligned, hence these types.
+ */
+typedef void *unaligned_ptr __attribute__((aligned(1), may_alias));
+typedef uint64_t unaligned_u64 __attribute__((aligned(1), may_alias));
+static char *split_base;
+static size_t split_stride;
+static size_t split_mask;
+
+/* layout of the standard chain currently present in the area, if any, so
+ * that columns using the same word type reuse it instead of refilling it.
+ */
+static void *chain_area;
+static size_t chain_size;
+static unsigned int chain_word;
+
+/* page backing of the allocated areas */
+#define BACK_DEFAULT  0   // let the system decide
+#define BACK_4K       1   // normal pages only
+#define BACK_THP      2   // transparent huge pages
+#define BACK_HUGETLB  3   // explicit huge pages from hugetlbfs
+
+static int backing = BACK_DEFAULT;
+
+#if defined(__linux__) && defined(CPU_COUNT)
+#define MAX_GROUPS 64
+
+/* a group of CPUs sharing the same memory node or the same cluster */
+struct cpu_group {
+	char name[8];
+	cpu_set_t cpus;
+};
+
+static struct cpu_group groups[MAX_GROUPS];
+static int nbgroups;
+#endif
 
 #if (_POSIX_MEMORY_PROTECTION - 0 < 200112L)
 static inline int posix_memalign(void **memptr, size_t alignment, size_t size)
@@ -67,10 +186,17 @@ static inline __attribute__((unused)) uint64_t rbit64(uint64_t x)
 	return x;
 }
 
+/* forgets the cached chain layout, to be called when the area is modified */
+static inline void forget_chain()
+{
+	chain_area = NULL;
+}
+
+/* Note: offsets are 32-bit so the area may not be larger than 4GB */
 static void fill_area_32(void *area, size_t size)
 {
 	uint32_t *base = (uint32_t *)area;
-	uint32_t ofs, addr;
+	uint64_t ofs, addr;
 
 	ofs = size / 2;
 	for (addr = 0; addr < size / sizeof(uint32_t); addr++) {
@@ -143,6 +269,100 @@ static void fill_area_ptr(void *area, size_t size)
 	}
 }
 
+/* Builds a pointer chain over <count> words spaced by <stride> bytes starting
+ * at <area>, then looping back to <area>. With a large power-of-two stride,
+ * all of them map to the same cache set, so that the walk latency jumps once
+ * <count> exceeds the number of ways of the cache level being hit.
+ */
+static void fill_area_sets(void *area, size_t stride, unsigned int count)
+{
+	unsigned int i;
+
+	forget_chain();
+
+	for (i = 0; i < count; i++)
+		*(void **)(area + i * stride) = area + ((i + 1) % count) * stride;
+}
+
+/* Builds a pointer chain visiting pairs of words <dist> bytes apart, in blocks
+ * of <block> bytes taken in bit-reversed order over <size> bytes. As long as
+ * <dist> is smaller than the cache line size, the second word of each pair is
+ * a hit, so the average latency jumps once <dist> reaches the line size. Both
+ * <size> and <block> must be powers of two, and <dist> lower than <block>.
+ */
+static void fill_area_pairs(void *area, size_t size, size_t block, size_t dist)
+{
+	uint64_t blk, next, nblk;
+	int bits;
+
+	forget_chain();
+
+	nblk = size / block;
+	for (bits = 0; nblk >> bits > 1; bits++)
+		;
+
+	for (blk = 0; blk < nblk; blk++) {
+		next = bits ? rbit64(rbit64(blk << (64 - bits)) + 1) >> (64 - bits) : 0;
+		if (next >= nblk)
+			next = 0;
+		*(void **)(area + blk * block) = area + blk * block + dist;
+		*(void **)(area + blk * block + dist) = area + next * block;
+	}
+}
+
+/* Builds a pointer chain over <size> bytes of area <area> at a constant
+ * <stride>, split into <streams> interleaved streams each covering its own
+ * part of the area. The chain visits the first word of each stream, then the
+ * second one of each stream and so on. When <backwards> is set, each stream
+ * is walked from its end to its beginning. The first word is always at the
+ * beginning of the area.
+ */
+static void fill_area_stride(void *area, size_t size, size_t stride, unsigned int streams, int backwards)
+{
+	size_t part = size / streams;
+	size_t steps = part / stride;
+	size_t step, next;
+	unsigned int str;
+	void **cur, **prev = NULL;
+
+	forget_chain();
+
+	for (step = 0; step < steps; step++) {
+		next = backwards ? (steps - step) % steps : step;
+		for (str = 0; str < streams; str++) {
+			cur = area + str * part + next * stride;
+			if (prev)
+				*prev = cur;
+			prev = cur;
+		}
+	}
+	*prev = area;
+}
+
+/* Builds a pointer chain over objects of <objsz> bytes taken in bit-reversed
+ * order over <size> bytes of area <area>. The first word of each object points
+ * to the next object, and all other words are zero. Both <size> and <objsz>
+ * must be powers of two.
+ */
+static void fill_area_objs(void *area, size_t size, size_t objsz)
+{
+	uint64_t obj, next, nobj;
+	int bits;
+
+	forget_chain();
+
+	nobj = size / objsz;
+	for (bits = 0; nobj >> bits > 1; bits++)
+		;
+
+	for (obj = 0; obj < nobj; obj++) {
+		next = bits ? rbit64(rbit64(obj << (64 - bits)) + 1) >> (64 - bits) : 0;
+		if (next >= nobj)
+			next = 0;
+		memset(area + obj * objsz, 0, objsz);
+		*(void **)(area + obj * objsz) = area + next * objsz;
+	}
+}
 
 /*****************************************************************************
  *                            pointer accesses                               *
@@ -187,6 +407,54 @@ unsigned int run_1ptr_generic(void *area)
 	return rounds;
 }
 
+/* prefetches the word <pf_ofs> bytes after <ptr> and returns the next pointer */
+static inline void **pf_next(void **ptr)
+{
+	__builtin_prefetch((char *)ptr + pf_ofs, 0);
+	return *ptr;
+}
+
+/* runs the single pointer test with software prefetching <pf_ofs> bytes ahead,
+ * returns the number of rounds
+ */
+unsigned int run_1ptr_prefetch(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	void **ofs0;
+
+	if (!area)
+		return 256 + sizeof(ofs0);
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = &((void**)area)[0];
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory reads
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+			ofs0 = pf_next(ofs0);
+		}
+		asm("" :: "r"(ofs0));
+	}
+	return rounds;
+}
+
 /* runs the dual pointer test, returns the number of rounds */
 unsigned int run_2ptr_generic(void *area)
 {
@@ -354,299 +622,2067 @@ unsigned int run_8ptr_generic(void *area)
 }
 
 /*****************************************************************************
- *                              32-bit accesses                              *
+ *                     pointer read-modify-write accesses                    *
  *****************************************************************************/
 
-/* runs the single 32-bit test, returns the number of rounds */
-unsigned int run_1w32_generic(void *area)
+/* reads the next pointer from <ptr> and writes it back to dirty the line */
+static inline void **rmw(void **ptr)
+{
+	void *next = *ptr;
+
+	*(void * volatile *)ptr = next;
+	return next;
+}
+
+/* runs the single pointer RMW test, returns the number of rounds */
+unsigned int run_1rmw_generic(void *area)
 {
 	unsigned int rounds;
 	unsigned int loop;
-	uint32_t ofs0;
+	void **ofs0;
 
 	if (!area)
-		return sizeof(ofs0);
+		return 256 + sizeof(ofs0);
 
 	for (rounds = 0; !stop_now; rounds++) {
-		ofs0 = 0;
+		ofs0 = &((void**)area)[0];
 		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
-			// 16 memory reads
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs0 = *(uint32_t *)(area + ofs0);
+			// 16 memory reads+writes
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
+			ofs0 = rmw(ofs0);
 		}
 		asm("" :: "r"(ofs0));
 	}
 	return rounds;
 }
 
-/* runs the dual 32-bit test, returns the number of rounds */
-unsigned int run_2w32_generic(void *area)
+/* runs the dual pointer RMW test, returns the number of rounds */
+unsigned int run_2rmw_generic(void *area)
 {
 	unsigned int rounds;
 	unsigned int loop;
-	uint32_t ofs0;
-	uint32_t ofs1;
+	void **ofs0;
+	void **ofs1;
 
 	if (!area)
-		return (1 << 16) + sizeof(ofs0);
+		return (1 << 16) + 256 + sizeof(ofs0);
 
 	for (rounds = 0; !stop_now; rounds++) {
-		ofs0 = 0;
-		ofs1 = 64;
+		ofs0 = (void**)area + 0;
+		ofs1 = (void**)area + 64;
 		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
-			// 16 memory dual reads
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
+			// 16 memory dual-reads+writes
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1);
+		}
+		asm("" :: "r"(ofs0));
+		asm("" :: "r"(ofs1));
+	}
+	return rounds;
+}
 
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
+/* runs the quad pointer RMW test, returns the number of rounds */
+unsigned int run_4rmw_generic(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	void **ofs0;
+	void **ofs1;
+	void **ofs2;
+	void **ofs3;
 
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
+	if (!area)
+		return (3 << 16) + 256 + sizeof(ofs0);
 
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
-			ofs0 = *(uint32_t *)(area + ofs0);
-			ofs1 = *(uint32_t *)(area + ofs1);
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = (void**)area + 0;
+		ofs1 = (void**)area + 64;
+		ofs2 = (void**)area + 128;
+		ofs3 = (void**)area + 192;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory quad-reads+writes
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
+			ofs0 = rmw(ofs0); ofs1 = rmw(ofs1); ofs2 = rmw(ofs2); ofs3 = rmw(ofs3);
 		}
 		asm("" :: "r"(ofs0));
 		asm("" :: "r"(ofs1));
+		asm("" :: "r"(ofs2));
+		asm("" :: "r"(ofs3));
 	}
 	return rounds;
 }
 
-
 /*****************************************************************************
- *                              64-bit accesses                              *
+ *                               object accesses                             *
  *****************************************************************************/
 
-/* runs the single 64-bit test, returns the number of rounds */
-unsigned int run_1w64_generic(void *area)
+/* Reads the whole <obj_size> bytes object at <ptr> using independent loads and
+ * returns the OR of all its words. Since only the first word is not zero, this
+ * is the pointer to the next object, which thus depends on the whole object,
+ * as when looking up a key in a tree node or a hash bucket.
+ */
+static inline void **obj_next(void **ptr)
+{
+	const void *end = (void *)ptr + obj_size;
+#if defined(__AVX2__) && defined(__x86_64__)
+	const __m256i *w = (const __m256i *)ptr;
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m128i acc;
+
+	for (; (void *)w < end; w += 2) {
+		acc0 = _mm256_or_si256(acc0, _mm256_load_si256(w));
+		acc1 = _mm256_or_si256(acc1, _mm256_load_si256(w + 1));
+	}
+	acc0 = _mm256_or_si256(acc0, acc1);
+	acc = _mm_or_si128(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	acc = _mm_or_si128(acc, _mm_unpackhi_epi64(acc, acc));
+	return (void **)_mm_cvtsi128_si64(acc);
+#elif defined(__SSE2__) && defined(__x86_64__)
+	const __m128i *w = (const __m128i *)ptr;
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+
+	for (; (void *)w < end; w += 2) {
+		acc0 = _mm_or_si128(acc0, _mm_load_si128(w));
+		acc1 = _mm_or_si128(acc1, _mm_load_si128(w + 1));
+	}
+	acc0 = _mm_or_si128(acc0, acc1);
+	acc0 = _mm_or_si128(acc0, _mm_unpackhi_epi64(acc0, acc0));
+	return (void **)_mm_cvtsi128_si64(acc0);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	const uint64_t *w = (const uint64_t *)ptr;
+	uint64x2_t acc0 = vdupq_n_u64(0);
+	uint64x2_t acc1 = vdupq_n_u64(0);
+
+	for (; (void *)w < end; w += 4) {
+		acc0 = vorrq_u64(acc0, vld1q_u64(w));
+		acc1 = vorrq_u64(acc1, vld1q_u64(w + 2));
+	}
+	acc0 = vorrq_u64(acc0, acc1);
+	return (void **)(vgetq_lane_u64(acc0, 0) | vgetq_lane_u64(acc0, 1));
+#else
+	const unsigned long *w = (const unsigned long *)ptr;
+	unsigned long acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+
+	for (; (void *)w < end; w += 4) {
+		acc0 |= w[0];
+		acc1 |= w[1];
+		acc2 |= w[2];
+		acc3 |= w[3];
+	}
+	return (void **)(acc0 | acc1 | acc2 | acc3);
+#endif
+}
+
+/* runs the single object test, returns the number of rounds of
+ * OBJ_LOOPS_PER_ROUND objects.
+ */
+unsigned int run_obj(void *area)
 {
 	unsigned int rounds;
 	unsigned int loop;
-	uint64_t ofs0;
-
-	if (!area)
-		return sizeof(ofs0);
+	void **ofs0;
 
 	for (rounds = 0; !stop_now; rounds++) {
-		ofs0 = 0;
-		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
-			// 16 memory reads
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
+		ofs0 = &((void**)area)[0];
+		for (loop = 0; loop < OBJ_LOOPS_PER_ROUND; loop += 4) {
+			// 4 object reads
+			ofs0 = obj_next(ofs0);
+			ofs0 = obj_next(ofs0);
+			ofs0 = obj_next(ofs0);
+			ofs0 = obj_next(ofs0);
+		}
+		asm("" :: "r"(ofs0));
+	}
+	return rounds;
+}
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
+/*****************************************************************************
+ *                           latency hiding lookups                          *
+ *****************************************************************************/
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
+/* runs the lookups one at a time, returns the number of rounds of
+ * LK_PER_ROUND lookups.
+ */
+unsigned int run_lk_naive(void *area)
+{
+	unsigned int rounds;
+	unsigned int i, hops;
+	uintptr_t sum = 0;
+	void **p;
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs0 = *(uint64_t *)(area + ofs0);
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < LK_PER_ROUND; i++) {
+			p = lk_start[i];
+			for (hops = lk_hops[i]; hops; hops--)
+				p = *p;
+			sum += (uintptr_t)p;
 		}
-		asm("" :: "r"(ofs0));
 	}
+	asm("" :: "r"(sum));
 	return rounds;
 }
 
-/* runs the dual 64-bit test, returns the number of rounds */
-unsigned int run_2w64_generic(void *area)
+/* runs the lookups in groups of <lk_width>, all advancing one hop at a time:
+ * the nodes of the whole group are prefetched, then read. Returns the number
+ * of rounds of LK_PER_ROUND lookups.
+ */
+unsigned int run_lk_group(void *area)
 {
+	unsigned char left[LK_MAX_WIDTH];
+	void **p[LK_MAX_WIDTH];
+	unsigned int width = lk_width < LK_MAX_WIDTH ? lk_width : LK_MAX_WIDTH;
 	unsigned int rounds;
-	unsigned int loop;
-	uint64_t ofs0;
-	uint64_t ofs1;
-
-	if (!area)
-		return (1 << 16) + sizeof(ofs0);
+	unsigned int i, g, n, active;
+	uintptr_t sum = 0;
 
 	for (rounds = 0; !stop_now; rounds++) {
-		ofs0 = 0;
-		ofs1 = 64;
-		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
-			// 16 memory dual reads
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
+		for (i = 0; i < LK_PER_ROUND; i += n) {
+			n = LK_PER_ROUND - i < width ? LK_PER_ROUND - i : width;
+			for (g = 0; g < n; g++) {
+				p[g] = lk_start[i + g];
+				left[g] = lk_hops[i + g];
+			}
+			do {
+				for (g = 0; g < n; g++)
+					if (left[g])
+						__builtin_prefetch(p[g], 0);
+				for (active = g = 0; g < n; g++) {
+					if (left[g]) {
+						p[g] = *p[g];
+						active |= --left[g];
+					}
+				}
+			} while (active);
+			for (g = 0; g < n; g++)
+				sum += (uintptr_t)p[g];
+		}
+	}
+	asm("" :: "r"(sum));
+	return rounds;
+}
+
+/* runs the lookups using asynchronous memory access chaining (AMAC): a ring of
+ * <lk_width> in-flight lookups is visited in turn; each visit reads the node
+ * prefetched on the previous visit, prefetches the next one, and replaces the
+ * lookup with the next pending one as soon as it completes. Returns the
+ * number of rounds of LK_PER_ROUND lookups.
+ */
+unsigned int run_lk_amac(void *area)
+{
+	unsigned char left[LK_MAX_WIDTH];
+	void **p[LK_MAX_WIDTH];
+	unsigned int width = lk_width < LK_MAX_WIDTH ? lk_width : LK_MAX_WIDTH;
+	unsigned int rounds;
+	unsigned int g, next, done;
+	uintptr_t sum = 0;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		/* note: width is always lower than LK_PER_ROUND */
+		for (next = g = 0; g < width; g++) {
+			p[g] = lk_start[next];
+			left[g] = lk_hops[next++];
+			__builtin_prefetch(p[g], 0);
+		}
+
+		for (done = g = 0; done < LK_PER_ROUND; g = (g + 1 == width) ? 0 : g + 1) {
+			if (!left[g])
+				continue;
+			p[g] = *p[g];
+			if (--left[g]) {
+				__builtin_prefetch(p[g], 0);
+				continue;
+			}
+			sum += (uintptr_t)p[g];
+			done++;
+			if (next < LK_PER_ROUND) {
+				p[g] = lk_start[next];
+				left[g] = lk_hops[next++];
+				__builtin_prefetch(p[g], 0);
+			}
+		}
+	}
+	asm("" :: "r"(sum));
+	return rounds;
+}
+
+/* runs the lookups as <lk_width> interleaved streams, each processing its own
+ * share of the lookups like a coroutine that prefetches the next node then
+ * yields to the next stream after each read. Returns the number of rounds of
+ * LK_PER_ROUND lookups.
+ */
+unsigned int run_lk_coro(void *area)
+{
+	unsigned int idx[LK_MAX_WIDTH];
+	unsigned char left[LK_MAX_WIDTH];
+	void **p[LK_MAX_WIDTH];
+	unsigned int width = lk_width < LK_MAX_WIDTH ? lk_width : LK_MAX_WIDTH;
+	unsigned int rounds;
+	unsigned int g, active;
+	uintptr_t sum = 0;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		/* note: width is always lower than LK_PER_ROUND */
+		for (active = g = 0; g < width; g++) {
+			idx[g] = g;
+			p[g] = lk_start[g];
+			left[g] = lk_hops[g];
+			__builtin_prefetch(p[g], 0);
+			active++;
+		}
+
+		while (active) {
+			for (g = 0; g < width; g++) {
+				if (idx[g] >= LK_PER_ROUND)
+					continue;
+				p[g] = *p[g];
+				if (--left[g]) {
+					__builtin_prefetch(p[g], 0);
+					continue;
+				}
+				sum += (uintptr_t)p[g];
+				idx[g] += width;
+				if (idx[g] < LK_PER_ROUND) {
+					p[g] = lk_start[idx[g]];
+					left[g] = lk_hops[idx[g]];
+					__builtin_prefetch(p[g], 0);
+				}
+				else
+					active--;
+			}
+		}
+	}
+	asm("" :: "r"(sum));
+	return rounds;
+}
+
+/*****************************************************************************
+ *                              gather accesses                              *
+ *****************************************************************************/
+
+/* All gather tests read the 64-bit words of table <area> designated by the
+ * GT_IDX indexes of gt_idx[] (only their low half for 32-bit reads), and
+ * return the number of rounds of GT_IDX reads. The loaded values are not
+ * combined so that the reads remain independent.
+ */
+
+/* runs the scalar 32-bit loads */
+unsigned int run_gt_1x32(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 4) {
+			asm volatile("" : : "r" (*(uint32_t *)(area + (size_t)gt_idx[i + 0] * 8)));
+			asm volatile("" : : "r" (*(uint32_t *)(area + (size_t)gt_idx[i + 1] * 8)));
+			asm volatile("" : : "r" (*(uint32_t *)(area + (size_t)gt_idx[i + 2] * 8)));
+			asm volatile("" : : "r" (*(uint32_t *)(area + (size_t)gt_idx[i + 3] * 8)));
+		}
+	}
+	return rounds;
+}
+
+/* runs the scalar 64-bit loads */
+unsigned int run_gt_1x64(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 4) {
+			asm volatile("" : : "r" (*(uint64_t *)(area + (size_t)gt_idx[i + 0] * 8)));
+			asm volatile("" : : "r" (*(uint64_t *)(area + (size_t)gt_idx[i + 1] * 8)));
+			asm volatile("" : : "r" (*(uint64_t *)(area + (size_t)gt_idx[i + 2] * 8)));
+			asm volatile("" : : "r" (*(uint64_t *)(area + (size_t)gt_idx[i + 3] * 8)));
+		}
+	}
+	return rounds;
+}
+
+#if defined(__AVX2__)
+/* runs 8 32-bit loads per vpgatherdd */
+unsigned int run_gt_ymm32(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+	__m256i v;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 8) {
+			v = _mm256_i32gather_epi32(area, _mm256_loadu_si256((const __m256i *)(gt_idx + i)), 8);
+			asm volatile("" : : "x" (v));
+		}
+	}
+	return rounds;
+}
+
+/* runs 4 64-bit loads per vpgatherqq */
+unsigned int run_gt_ymm64(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+	__m256i v;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 4) {
+			v = _mm256_i64gather_epi64(area, _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(gt_idx + i))), 8);
+			asm volatile("" : : "x" (v));
+		}
+	}
+	return rounds;
+}
+#endif
+
+#if defined(__AVX512F__)
+/* runs 16 32-bit loads per vpgatherdd */
+unsigned int run_gt_zmm32(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+	__m512i v;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 16) {
+			v = _mm512_i32gather_epi32(_mm512_loadu_si512(gt_idx + i), area, 8);
+			asm volatile("" : : "v" (v));
+		}
+	}
+	return rounds;
+}
+
+/* runs 8 64-bit loads per vpgatherqq */
+unsigned int run_gt_zmm64(void *area)
+{
+	unsigned int rounds;
+	unsigned int i;
+	__m512i v;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (i = 0; i < GT_IDX; i += 8) {
+			v = _mm512_i64gather_epi64(_mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)(gt_idx + i))), area, 8);
+			asm volatile("" : : "v" (v));
+		}
+	}
+	return rounds;
+}
+#endif
+
+/*****************************************************************************
+ *                           split line/page accesses                        *
+ *****************************************************************************/
+
+/* runs the pointer chain over the slots starting at split_base, returns the
+ * number of rounds.
+ */
+unsigned int run_split_chase(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	void *ofs0;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = split_base;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 8) {
+			// 8 memory reads
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+			ofs0 = *(unaligned_ptr *)ofs0;
+		}
+		asm("" :: "r"(ofs0));
+	}
+	return rounds;
+}
+
+/* runs independent loads of all slots in turn, returns the number of rounds */
+unsigned int run_split_load(void *area)
+{
+	const size_t stride = split_stride;
+	const size_t mask = split_mask;
+	const char *base = split_base;
+	unsigned int rounds;
+	unsigned int loop;
+	size_t pos = 0;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 4) {
+			// 4 memory reads
+			asm volatile("" : : "r" (*(unaligned_u64 *)(base + pos)));
+			asm volatile("" : : "r" (*(unaligned_u64 *)(base + ((pos + stride) & mask))));
+			asm volatile("" : : "r" (*(unaligned_u64 *)(base + ((pos + 2 * stride) & mask))));
+			asm volatile("" : : "r" (*(unaligned_u64 *)(base + ((pos + 3 * stride) & mask))));
+			pos = (pos + 4 * stride) & mask;
+		}
+	}
+	return rounds;
+}
+
+/* runs independent stores to all slots in turn, returns the number of rounds.
+ * Note: this destroys the chain.
+ */
+unsigned int run_split_store(void *area)
+{
+	const size_t stride = split_stride;
+	const size_t mask = split_mask;
+	char *base = split_base;
+	unsigned int rounds;
+	unsigned int loop;
+	size_t pos = 0;
+
+	for (rounds = 0; !stop_now; rounds++) {
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 4) {
+			// 4 memory writes
+			*(volatile unaligned_u64 *)(base + pos) = pos;
+			*(volatile unaligned_u64 *)(base + ((pos + stride) & mask)) = pos;
+			*(volatile unaligned_u64 *)(base + ((pos + 2 * stride) & mask)) = pos;
+			*(volatile unaligned_u64 *)(base + ((pos + 3 * stride) & mask)) = pos;
+			pos = (pos + 4 * stride) & mask;
+		}
+	}
+	return rounds;
+}
+
+/*****************************************************************************
+ *                              32-bit accesses                              *
+ *****************************************************************************/
+
+/* runs the single 32-bit test, returns the number of rounds */
+unsigned int run_1w32_generic(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	uint32_t ofs0;
+
+	if (!area)
+		return sizeof(ofs0);
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = 0;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory reads
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs0 = *(uint32_t *)(area + ofs0);
+		}
+		asm("" :: "r"(ofs0));
+	}
+	return rounds;
+}
+
+/* runs the dual 32-bit test, returns the number of rounds */
+unsigned int run_2w32_generic(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	uint32_t ofs0;
+	uint32_t ofs1;
+
+	if (!area)
+		return (1 << 16) + sizeof(ofs0);
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = 0;
+		ofs1 = 64;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory dual reads
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+			ofs0 = *(uint32_t *)(area + ofs0);
+			ofs1 = *(uint32_t *)(area + ofs1);
+		}
+		asm("" :: "r"(ofs0));
+		asm("" :: "r"(ofs1));
+	}
+	return rounds;
+}
+
+
+/*****************************************************************************
+ *                              64-bit accesses                              *
+ *****************************************************************************/
+
+/* runs the single 64-bit test, returns the number of rounds */
+unsigned int run_1w64_generic(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	uint64_t ofs0;
+
+	if (!area)
+		return sizeof(ofs0);
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = 0;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory reads
 			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
 			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs0 = *(uint64_t *)(area + ofs0);
+		}
+		asm("" :: "r"(ofs0));
+	}
+	return rounds;
+}
+
+/* runs the dual 64-bit test, returns the number of rounds */
+unsigned int run_2w64_generic(void *area)
+{
+	unsigned int rounds;
+	unsigned int loop;
+	uint64_t ofs0;
+	uint64_t ofs1;
+
+	if (!area)
+		return (1 << 16) + sizeof(ofs0);
+
+	for (rounds = 0; !stop_now; rounds++) {
+		ofs0 = 0;
+		ofs1 = 64;
+		for (loop = 0; loop < LOOPS_PER_ROUND; loop += 16) {
+			// 16 memory dual reads
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+			ofs0 = *(uint64_t *)(area + ofs0);
+			ofs1 = *(uint64_t *)(area + ofs1);
+		}
+		asm("" :: "r"(ofs0));
+		asm("" :: "r"(ofs1));
+	}
+	return rounds;
+}
+
+
+/*****************************************************************************
+ *                                 allocation                                *
+ *****************************************************************************/
+
+/* returns the size of huge pages, which is also the area alignment */
+static size_t hugepage_size()
+{
+	static size_t hps;
+	unsigned long val;
+	FILE *f;
+
+	if (hps)
+		return hps;
+
+	hps = 2 * 1048576;
+	f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	if (f) {
+		if (fscanf(f, "%lu", &val) == 1 && val && !(val & (val - 1)))
+			hps = val;
+		fclose(f);
+	}
+	return hps;
+}
+
+/* returns the size of pages that the <backing> mode will use */
+static size_t backing_page_size()
+{
+	if (backing == BACK_THP || backing == BACK_HUGETLB)
+		return hugepage_size();
+	return sysconf(_SC_PAGESIZE);
+}
+
+/* Allocates an area of <size> bytes aligned to the huge page size, using the
+ * page backing configured in <backing>. The size is rounded up to the next
+ * huge page for hugetlbfs. Returns NULL on failure. The area must be released
+ * using free_area() with the same size.
+ */
+static void *alloc_area(size_t size)
+{
+	size_t align = hugepage_size();
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *area, *aligned;
+
+	size = (size + align - 1) & -align;
+
+	if (backing == BACK_HUGETLB) {
+#ifdef MAP_HUGETLB
+		/* hugetlbfs mappings are naturally aligned */
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		return (area == MAP_FAILED) ? NULL : area;
+#else
+		return NULL;
+#endif
+	}
+
+	area = mmap(NULL, size + align, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+
+	/* trim the unaligned head and the tail */
+	aligned = (void *)(((uintptr_t)area + align - 1) & -align);
+	if (aligned != area)
+		munmap(area, aligned - area);
+	munmap(aligned + size, area + align - aligned);
+
+#ifdef MADV_HUGEPAGE
+	if (backing == BACK_4K)
+		madvise(aligned, size, MADV_NOHUGEPAGE);
+	else if (backing == BACK_THP)
+		madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+/* releases area <area> of <size> bytes allocated with alloc_area() */
+static void free_area(void *area, size_t size)
+{
+	size_t align = hugepage_size();
+
+	if (area == chain_area)
+		forget_chain();
+
+	munmap(area, (size + align - 1) & -align);
+}
+
+/*****************************************************************************
+ *                                 measurements                              *
+ *****************************************************************************/
+
+/* returns a timestamp in microseconds */
+static inline uint64_t rdtsc()
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec tv;
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return (tv.tv_sec * 1000000000ULL + tv.tv_nsec) / 1000ULL;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+#endif
+}
+
+/* Returns a cycle counter value once all previous loads have completed. The
+ * counter's frequency may be unrelated to the CPU's, see cycles_per_usec().
+ */
+static inline uint64_t read_cycles()
+{
+#if defined(__SSE2__)
+	unsigned int aux;
+
+	return __rdtscp(&aux);
+#elif defined(__aarch64__)
+	uint64_t cnt;
+
+	asm volatile("dsb ld; isb; mrs %0, cntvct_el0" : "=r" (cnt) : : "memory");
+	return cnt;
+#else
+	struct timespec tv;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec * 1000000000ULL + tv.tv_nsec;
+#endif
+}
+
+/* returns the number of read_cycles() units per microsecond, measured over
+ * about 20 milliseconds.
+ */
+static double cycles_per_usec()
+{
+	uint64_t start, end, cyc;
+
+	start = rdtsc();
+	cyc = read_cycles();
+	do {
+		end = rdtsc();
+	} while (end - start < 20000);
+	return (double)(read_cycles() - cyc) / (end - start);
+}
+
+/* just marks the alarm as received */
+void alarm_handler(int sig)
+{
+	stop_now = 1;
+}
+
+/* sets an alarm to trigger after <usec> microseconds. 0 disables it */
+void set_alarm(unsigned int usec)
+{
+	struct itimerval timer = {
+		.it_value.tv_usec = usec % 1000000,
+		.it_value.tv_sec  = usec / 1000000,
+	};
+
+	if (usec) {
+		stop_now = 0;
+		signal(SIGALRM, alarm_handler);
+		signal(SIGVTALRM, alarm_handler);
+	}
+	setitimer(ITIMER_VIRTUAL, &timer, NULL);
+}
+
+/* Rewrites one word every 32 bytes of <size> bytes of area <area> with its own
+ * value, so that all lines of the area are dirty.
+ */
+static void dirty_area(void *area, size_t size)
+{
+	size_t ofs;
+
+	for (ofs = 0; ofs < size; ofs += 32)
+		*(volatile uint32_t *)(area + ofs) = *(uint32_t *)(area + ofs);
+}
+
+/* Walks the chain already present in area <area> using function <fct> for
+ * about <usec> microseconds, then returns the number of words read per
+ * millisecond. When dirty_first and dirty_size are set, the measure is split
+ * into DIRTY_SLICES slices of at least one round each, and the area is dirtied
+ * again before each of them outside of the timed part, so that the lines
+ * visited remain dirty all along the measure and not only on the first pass.
+ */
+unsigned int walk_area(void *area, unsigned int usec, unsigned int (*fct)(void *))
+{
+	uint64_t rounds = 0, spent = 0;
+	uint64_t before, after;
+	unsigned int slice = usec;
+	int dirty = dirty_first && dirty_size;
+
+	if (dirty) {
+		slice = usec / DIRTY_SLICES;
+		if (slice < DIRTY_MIN_SLICE)
+			slice = DIRTY_MIN_SLICE;
+	}
+
+	do {
+		if (dirty)
+			dirty_area(area, dirty_size);
+
+		set_alarm(slice);
+		after = rdtsc();
+		before = rdtsc();
+		before += before - after; // compensate for the syscall time
+
+		rounds += fct(area);
+
+		after = rdtsc();
+		set_alarm(0);
+		spent += after - before;
+	} while (dirty && spent < usec);
+
+	/* speed = transactions per millisecond. Use 64-bit computations to avoid
+	 * overflows. The caller can turn this into bytes per second by multiplying
+	 * by <word>.
+	 */
+	if (spent < 1)
+		spent = 1;
+	rounds *= LOOPS_PER_ROUND;
+	return rounds * 1000ULL / spent;
+}
+
+/* Fills <size> bytes of area <area> with the chain expected by function #<fct>.
+ * Nothing is done if the area already contains the same chain (same word type
+ * and size), since the walk functions do not change it. Note: size is rounded
+ * down to the lower power of two.
+ */
+static void prepare_area(void *area, size_t size, int fct)
+{
+	unsigned int word;
+
+	/* only the word size and the pointer bit matter for the layout */
+	word = run[fct](NULL) & 511;
+
+	if (area == chain_area && size == chain_size && word == chain_word)
+		return;
+
+	chain_area = area;
+	chain_size = size;
+	chain_word = word;
+
+	if (word & 256)
+		fill_area_ptr(area, size);
+	else {
+		if ((word & 255) == 4)
+			fill_area_32(area, size);
+		else if ((word & 255) == 8)
+			fill_area_64(area, size);
+		else
+			abort();
+	}
+}
+
+/* Randomly accesses aligned words using function #<fct> over <size> bytes of
+ * area <area> for about <usec> microseconds, then returns the number of words
+ * read per millisecond. Note: size is rounded down to the lower power of two,
+ * and must be at least 4kB.
+ */
+unsigned int random_read_over_area(void *area, unsigned int usec, size_t size, int fct)
+{
+	unsigned int ret;
+
+	if (fct >= sizeof(run) / sizeof(*run))
+		return 0;
+
+	if (!run[fct])
+		return 0;
+
+	/* 32-bit offsets cannot reach beyond 4GB */
+	if ((run[fct](NULL) & 511) == 4 && (uint64_t)size > (1ULL << 32))
+		return 0;
+
+	prepare_area(area, size, fct);
+	dirty_size = size;
+	ret = walk_area(area, usec, run[fct]);
+	dirty_size = 0;
+	return ret;
+}
+
+/* prints latency <lat> in nanoseconds using 5 significant chars */
+static void print_lat(double lat)
+{
+	if (lat < 10.0)
+		printf("%1.3f ", lat);
+	else if (lat < 100.0)
+		printf("%2.2f ", lat);
+	else if (lat < 1000.0)
+		printf("%3.1f ", lat);
+	else
+		printf("%4.0f ", lat);
+}
+
+/* Prints rate <ret> (accesses per millisecond) of <bytes> bytes each according
+ * to format <fmt> (0=accesses per ms, 1=MB/s, 2=ns per access). A zero rate
+ * indicates a test that does not apply and is reported as "-".
+ */
+static void print_result(unsigned int ret, unsigned int bytes, int fmt)
+{
+	if (!ret) {
+		/* not applicable to this size */
+		printf("%*s ", (fmt == 1 || fmt == 2) ? 5 : 7, "-");
+	} else if (fmt == 1) {
+		/* bandwidth in MB/s */
+		printf("%5u ", (unsigned int)((uint64_t)ret * bytes / 1024U));
+	} else if (fmt == 2) {
+		/* nanoseconds per access */
+		print_lat(1000000.0 / ret);
+	} else {
+		/* accesses per millisecond */
+		printf("%7u ", ret);
+	}
+}
+
+/* Infers the cache geometry by chasing single pointers laid out to reveal the
+ * line size and the number of ways per set, over at most <size_max> bytes of
+ * area <area>. Each measure lasts <usec> microseconds. The first table shows
+ * the average latency of pairs of words <dist> bytes apart (the second one is
+ * a hit until <dist> reaches the line size). The second one shows the latency
+ * when walking over <count> words distant by power-of-two strides, which all
+ * land in the same set. Jumps reveal how many ways are available at each level
+ * (the stride needs to be at least as large as the way size of the level).
+ */
+static void geometry_probe(void *area, unsigned int usec, size_t size_max, int quiet)
+{
+	static const unsigned int counts[] = {
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+		17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+		40, 48, 56, 64, 0
+	};
+	double lat[sizeof(counts) / sizeof(*counts)][9];
+	double base = 0, prev = 0;
+	unsigned int line = 0;
+	size_t dist, stride, block = 1024;
+	int fct = 4; /* 1xPTR */
+	int row, col;
+
+	while (size_max & (size_max - 1))
+		size_max &= size_max - 1;
+
+	if (size_max < 2 * block) {
+		fprintf(stderr, "Fatal: area too small for geometry probe.\n");
+		exit(1);
+	}
+
+	if (!quiet)
+		printf("   dist:   ns\n");
+
+	for (dist = sizeof(void *); dist < block; dist *= 2) {
+		fill_area_pairs(area, size_max, block, dist);
+		prev = 1000000.0 / walk_area(area, usec, run[fct]);
+		if (!base)
+			base = prev;
+		else if (!line && prev > base * 1.25)
+			line = dist;
+		printf(quiet ? "%6u " : "%6uB: ", (unsigned int)dist);
+		print_lat(prev);
+		printf("\n");
+	}
+
+	if (line)
+		printf("line size: %u bytes\n", line);
+	else
+		printf("line size: unknown (above %u bytes ?)\n", (unsigned int)block / 2);
+
+	if (!quiet) {
+		printf("\n   ways:");
+		for (col = 0, stride = 4096; col < 9; col++, stride *= 2)
+			printf("%5uk", (unsigned int)(stride >> 10));
+		printf("\n");
+	}
+
+	for (row = 0; counts[row]; row++) {
+		printf(quiet ? "%6u " : "%6u: ", counts[row]);
+		for (col = 0, stride = 4096; col < 9; col++, stride *= 2) {
+			lat[row][col] = 0;
+			if (counts[row] * stride > size_max) {
+				printf("    - ");
+				continue;
+			}
+			fill_area_sets(area, stride, counts[row]);
+			lat[row][col] = 1000000.0 / walk_area(area, usec, run[fct]);
+			print_lat(lat[row][col]);
+		}
+		printf("\n");
+	}
+
+	/* report the number of words before each latency jump per stride. The
+	 * jump must persist on the next row to be reported, to filter noise.
+	 */
+	for (col = 0, stride = 4096; col < 9; col++, stride *= 2) {
+		int jumps = 0;
+
+		printf("stride %5uk: ways =", (unsigned int)(stride >> 10));
+		for (row = 1; counts[row] && lat[row][col]; row++) {
+			if (lat[row][col] > lat[row - 1][col] * 1.3 &&
+			    (!counts[row + 1] || !lat[row + 1][col] ||
+			     lat[row + 1][col] > lat[row - 1][col] * 1.3)) {
+				printf(" %u", counts[row - 1]);
+				jumps++;
+			}
+		}
+		printf(jumps ? "\n" : " ?\n");
+	}
+}
+
+/* Measures the rate of objects read per millisecond over area <area> for each
+ * area size from 4kB to <size_max> (or only those in mask <wins> if not zero),
+ * and each object size in <objs> (zero-terminated). Each object is entirely
+ * read before the next one is looked up. Each measure lasts <usec>
+ * microseconds. Results are reported according to format <fmt> where the
+ * bandwidth and latency are expressed per object.
+ */
+static void object_sweep(void *area, unsigned int usec, size_t size_max, uint64_t wins,
+                         const unsigned int *objs, int fmt, int quiet)
+{
+	unsigned int ret;
+	size_t size;
+	char str[16];
+	int col;
+
+	if (!quiet) {
+		printf("   size:");
+		for (col = 0; objs[col]; col++) {
+			if (objs[col] >= 1024)
+				snprintf(str, sizeof(str), "%uk", objs[col] >> 10);
+			else
+				snprintf(str, sizeof(str), "%uB", objs[col]);
+			printf((fmt == 1 || fmt == 2) ? "%6s" : "%8s", str);
+		}
+		printf("\n");
+	}
+
+	for (size = 4096; size <= size_max || size <= wins; size *= 2) {
+		if (wins && !(wins & size))
+			continue;
+		printf(quiet ? "%6llu " : "%6lluk: ", (unsigned long long)(size >> 10U));
+		for (col = 0; objs[col]; col++) {
+			ret = 0;
+			if (size >= 2 * objs[col]) {
+				obj_size = objs[col];
+				fill_area_objs(area, size, obj_size);
+				ret = walk_area(area, usec, run_obj) / OBJ_ROUND_RATIO;
+				if (!ret)
+					ret = 1;
+			}
+			print_result(ret, objs[col], fmt);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+}
+
+/* Compares techniques to hide the latency of independent lookups, each made
+ * of 1 to LK_MAX_HOPS dependent reads in the pointer chain covering <size>
+ * bytes of area <area>: naive, group prefetching, AMAC and interleaved
+ * streams. Each row shows one width from the zero-terminated list <widths>,
+ * which is the number of lookups processed in parallel. The naive approach
+ * does not depend on it and is only measured once. Each measure lasts <usec>
+ * microseconds. Results are reported according to format <fmt> per lookup.
+ */
+static void lookup_sweep(void *area, unsigned int usec, size_t size, const unsigned int *widths, int fmt, int quiet)
+{
+	static const char *lk_name[] = { "naive", "group", "amac", "coro" };
+	static unsigned int (* const lk_run[])(void *) = { run_lk_naive, run_lk_group, run_lk_amac, run_lk_coro };
+	unsigned int bytes, naive = 0;
+	uint64_t words, hops = 0, rnd = 0x9E3779B97F4A7C15ULL;
+	int row, col;
+
+	while (size & (size - 1))
+		size &= size - 1;
+
+	prepare_area(area, size, 4); /* 1xPTR */
+
+	/* xorshift64 to pick random start nodes and lengths */
+	words = size / sizeof(void *);
+	for (row = 0; row < LK_PER_ROUND; row++) {
+		rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+		lk_start[row] = (void **)area + rnd % words;
+		lk_hops[row] = 1 + (rnd >> 32) % LK_MAX_HOPS;
+		hops += lk_hops[row];
+	}
+	bytes = hops * sizeof(void *) / LK_PER_ROUND;
+
+	if (!quiet) {
+		printf("  width:");
+		for (col = 0; col < 4; col++)
+			printf((fmt == 1 || fmt == 2) ? "%6s" : "%8s", lk_name[col]);
+		printf("\n");
+	}
+
+	for (row = 0; widths[row]; row++) {
+		lk_width = widths[row];
+		printf(quiet ? "%6u " : "%6u: ", lk_width);
+		for (col = 0; col < 4; col++) {
+			unsigned int ret;
+
+			if (col == 0 && naive)
+				ret = naive;
+			else
+				ret = walk_area(area, usec, lk_run[col]) / LK_ROUND_RATIO;
+			if (!ret)
+				ret = 1;
+			if (col == 0)
+				naive = ret;
+			print_result(ret, bytes, fmt);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+}
+
+/* Fills gt_idx[] with GT_IDX indexes of 64-bit words in a table of <words>
+ * words (a power of two of at least 512), according to distribution <dist>.
+ */
+static void fill_gather_idx(size_t words, int dist)
+{
+	uint64_t rnd = 0x9E3779B97F4A7C15ULL;
+	size_t page = 0;
+	unsigned int i;
+
+	for (i = 0; i < GT_IDX; i++) {
+		/* xorshift64 */
+		rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+		if (dist == GT_SEQ)
+			gt_idx[i] = i & (words - 1);
+		else if (dist == GT_PAGE) {
+			if (!(i & 63))
+				page = (rnd >> 32) & (words - 1) & ~(size_t)511;
+			gt_idx[i] = page + (rnd & 511);
+		}
+		else if (dist == GT_SKEW)
+			gt_idx[i] = (rnd >> 3) & ((words - 1) >> (rnd & 7));
+		else
+			gt_idx[i] = rnd & (words - 1);
+	}
+}
+
+/* Compares scalar loads with the gather instructions supported by the CPU,
+ * reading 32-bit and 64-bit words at indexes following distribution <dist>
+ * over area <area>, for each area size from 4kB to <size_max> (or only those
+ * in mask <wins> if not zero). Indexes are stored as 32-bit values, so sizes
+ * above 16GB are not tested. Each measure lasts <usec> microseconds. Results
+ * are reported according to format <fmt> per word read.
+ */
+static void gather_sweep(void *area, unsigned int usec, size_t size_max, uint64_t wins,
+                         int dist, int fmt, int quiet)
+{
+	static const char *gt_name[6] = { "1x32", "ymm32", "zmm32", "1x64", "ymm64", "zmm64" };
+	unsigned int (*gt_run[6])(void *) = { run_gt_1x32, NULL, NULL, run_gt_1x64, NULL, NULL };
+	unsigned int ret;
+	size_t size;
+	int col;
+
+#if defined(__AVX2__)
+	gt_run[1] = run_gt_ymm32; gt_run[4] = run_gt_ymm64;
+#endif
+#if defined(__AVX512F__)
+	gt_run[2] = run_gt_zmm32; gt_run[5] = run_gt_zmm64;
+#endif
+
+	gt_idx = malloc(GT_IDX * sizeof(*gt_idx));
+	if (!gt_idx) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+	if (!quiet) {
+		printf("   size:");
+		for (col = 0; col < 6; col++)
+			if (gt_run[col])
+				printf((fmt == 1 || fmt == 2) ? "%6s" : "%8s", gt_name[col]);
+		printf("\n");
+	}
+
+	for (size = 4096; size <= size_max || size <= wins; size *= 2) {
+		if (wins && !(wins & size))
+			continue;
+		printf(quiet ? "%6llu " : "%6lluk: ", (unsigned long long)(size >> 10U));
+
+		if ((uint64_t)size <= (8ULL << 31)) {
+			fill_gather_idx(size / 8, dist);
+			/* really map the table instead of reading the zero page */
+			forget_chain();
+			memset(area, 0x55, size);
+		}
+
+		for (col = 0; col < 6; col++) {
+			if (!gt_run[col])
+				continue;
+			ret = 0;
+			if ((uint64_t)size <= (8ULL << 31)) {
+				ret = walk_area(area, usec, gt_run[col]);
+				if (!ret)
+					ret = 1;
+			}
+			print_result(ret, col < 3 ? 4 : 8, fmt);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	free(gt_idx);
+}
+
+/* Builds a pointer chain over the slots located every <stride> bytes at
+ * offset <ofs> in the first <size> bytes of area <area> (which must allow the
+ * last word to cross its end), visiting them in bit-reversed order, and sets
+ * the split_* variables accordingly.
+ */
+static void fill_area_split(void *area, size_t size, size_t stride, size_t ofs)
+{
+	uint64_t count = size / stride;
+	uint64_t idx, cur, next;
+	int bits;
+
+	forget_chain();
+
+	for (bits = 0; (1ULL << bits) < count; bits++)
+		;
+
+	split_base = area + ofs;
+	split_stride = stride;
+	split_mask = size - 1;
+
+	for (idx = 0; idx < count; idx++) {
+		cur = bits ? rbit64(idx) >> (64 - bits) : 0;
+		next = bits ? rbit64((idx + 1) & (count - 1)) >> (64 - bits) : 0;
+		*(unaligned_ptr *)(split_base + cur * stride) = split_base + next * stride;
+	}
+}
+
+/* Measures the cost of accessing 64-bit words at each offset within a cache
+ * line, then straddling 4kB and 2MB boundaries, over <size> bytes of area
+ * <area> (rounded down to a power of two). Each row places one word every 64
+ * bytes at offsets 0 to 63 (those above 56 are split across two lines), then
+ * one word every 4kB and 2MB, first aligned ("4k+0", "2M+0") as a control at
+ * the same stride, then crossing the page boundary in its middle ("4k-4",
+ * "2M-4", the latter only crossing huge pages with -B thp or huge), so that
+ * the crossing penalty is the difference between these two rows rather than
+ * mixed with stride and TLB effects. The columns are the
+ * latency of a pointer chain over these words, and the throughput of
+ * independent loads and stores to them. Each measure lasts <usec>
+ * microseconds. Results are reported according to format <fmt>.
+ */
+static void split_sweep(void *area, unsigned int usec, size_t size, int fmt, int quiet)
+{
+	static const char *split_name[] = { "chase", "load", "store" };
+	static unsigned int (* const split_run[])(void *) = { run_split_chase, run_split_load, run_split_store };
+	unsigned int ret;
+	size_t stride, ofs;
+	char str[16];
+	int row, col;
+
+	while (size & (size - 1))
+		size &= size - 1;
+
+	if (!quiet) {
+		printf("    ofs:");
+		for (col = 0; col < 3; col++)
+			printf((fmt == 1 || fmt == 2) ? "%6s" : "%8s", split_name[col]);
+		printf("\n");
+	}
+
+	for (row = 0; row < 68; row++) {
+		if (row < 64) {
+			stride = 64;
+			ofs = row;
+			snprintf(str, sizeof(str), "%d", row);
+		} else {
+			/* aligned control row then crossing row for each stride */
+			stride = (row < 66) ? 4096 : 2097152;
+			ofs = (row & 1) ? stride - 4 : 0;
+			snprintf(str, sizeof(str), "%s%s", (row < 66) ? "4k" : "2M", (row & 1) ? "-4" : "+0");
+		}
+
+		printf(quiet ? "%6s " : "%6s: ", str);
+		for (col = 0; col < 3; col++) {
+			ret = 0;
+			if (size >= 2 * stride) {
+				/* the store test destroys the chain */
+				if (col == 0)
+					fill_area_split(area, size, stride, ofs);
+				ret = walk_area(area, usec, split_run[col]);
+				if (!ret)
+					ret = 1;
+			}
+			print_result(ret, 8, fmt);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+}
+
+/* Measures the latency of single pointer chains walked at constant strides
+ * from 64 bytes to 16 pages over <size> bytes of area <area>, to show how
+ * hardware prefetchers perform. The columns are a forward stream, a backward
+ * stream, 2, 4 and 8 interleaved forward streams, then a forward stream with
+ * software prefetching of the pointer that is <dists[i]> strides ahead for
+ * each non-zero value of the <dists> array. Each measure lasts <usec>
+ * microseconds. Results are reported in nanoseconds per access.
+ */
+static void stride_sweep(void *area, unsigned int usec, size_t size, const unsigned int *dists, int quiet)
+{
+	static const char *stream_name[] = { "fwd", "bwd", "2fwd", "4fwd", "8fwd" };
+	static const unsigned int stream_cnt[] = { 1, 1, 2, 4, 8 };
+	size_t stride;
+	int col, dist;
+
+	while (size & (size - 1))
+		size &= size - 1;
+
+	if (!quiet) {
+		printf(" stride:");
+		for (col = 0; col < 5; col++)
+			printf("%6s", stream_name[col]);
+		for (dist = 0; dists[dist]; dist++)
+			printf("  pf%-2u", dists[dist]);
+		printf("\n");
+	}
+
+	for (stride = 64; stride <= 65536 && stride * 16 <= size; stride *= 2) {
+		printf(quiet ? "%6u " : "%6uB: ", (unsigned int)stride);
+		for (col = 0; col < 5; col++) {
+			fill_area_stride(area, size, stride, stream_cnt[col], col == 1);
+			print_lat(1000000.0 / walk_area(area, usec, run_1ptr_generic));
+			fflush(stdout);
+		}
+
+		fill_area_stride(area, size, stride, 1, 0);
+		for (dist = 0; dists[dist]; dist++) {
+			pf_ofs = (long)stride * dists[dist];
+			print_lat(1000000.0 / walk_area(area, usec, run_1ptr_prefetch));
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+}
+
+/* Builds a pointer chain touching one word in each of the first <count> pages
+ * of <page> bytes of area <area>. Pages are visited in a scattered order to
+ * defeat next-page prefetchers. The word is taken at a different line in each
+ * page so that the lines spread over all cache sets and stay cached as long as
+ * possible, leaving the translation as the main cost. The first word is at the
+ * beginning of the area.
+ */
+static void fill_area_pages(void *area, size_t page, uint64_t count)
+{
+	/* a prime number is coprime with any count, making a full cycle */
+	const uint64_t step = 2654435761ULL;
+	uint64_t idx, pg, next;
+
+	forget_chain();
+
+	for (idx = 0; idx < count; idx++) {
+		pg = idx * step % count;
+		next = (idx + 1) * step % count;
+		*(void **)(area + pg * page + (pg * 64) % page) =
+			area + next * page + (next * 64) % page;
+	}
+}
+
+/* Measures the latency of a single pointer chain touching one line per page
+ * over a growing number of pages of the configured backing size, within
+ * <size_max> bytes of area <area>. Each measure lasts <usec> microseconds. The
+ * latency plateaus reveal the reach and hit cost of the L1 dTLB, then STLB,
+ * then the cost of page walks. Note that beyond a few hundred pages, the lines
+ * may not fit in the L1 cache anymore, which adds to the measured cost.
+ */
+static void tlb_probe(void *area, unsigned int usec, size_t size_max, int quiet)
+{
+	static const char *level_name[] = { "L1 dTLB", "STLB", "page walk" };
+	size_t page = backing_page_size();
+	uint64_t count, reach = 0;
+	double lat, ref = 0, next_lat;
+	double lats[64];
+	uint64_t counts[64];
+	int rows, row, level;
+
+	if (size_max < 2 * page) {
+		fprintf(stderr, "Fatal: area too small for at least 2 pages of %u kB.\n", (unsigned int)(page >> 10));
+		exit(1);
+	}
+
+	if (!quiet)
+		printf("  pages:  size_kB     ns  (page=%ukB)\n", (unsigned int)(page >> 10));
+
+	/* powers of two and their midpoints */
+	for (rows = 0, count = 1; rows < 64 && count * page <= size_max; ) {
+		fill_area_pages(area, page, count);
+		lat = 1000000.0 / walk_area(area, usec, run_1ptr_generic);
+		printf(quiet ? "%7llu %9llu " : "%7llu: %8llu ",
+		       (unsigned long long)count, (unsigned long long)(count * page >> 10));
+		print_lat(lat);
+		printf("\n");
+		fflush(stdout);
+
+		counts[rows] = count;
+		lats[rows++] = lat;
+
+		if (count < 4 || (count & (count - 1)))
+			count = count < 4 ? count + 1 : (count & (count - 1)) * 2;
+		else
+			count += count / 2;
+	}
+
+	/* a level ends when the latency grows by more than 20%. The next level
+	 * starts on the first row that is stable with the next one, in order to
+	 * skip transitions and noise.
+	 */
+	for (level = row = 0; row < rows; row++) {
+		lat = lats[row];
+		next_lat = (row + 1 < rows) ? lats[row + 1] : lat;
+		if (!ref)
+			ref = lat;
+		if (lat <= ref * 1.2) {
+			reach = counts[row];
+			continue;
+		}
+		if (next_lat > lat * 1.2)
+			continue;
+		printf("%-9s: %6.2f ns, reach %llu pages (%llu kB)\n",
+		       level < 3 ? level_name[level] : "walk+",
+		       ref, (unsigned long long)reach,
+		       (unsigned long long)(reach * page >> 10));
+		level++;
+		ref = lat;
+		reach = counts[row];
+	}
+	printf("%-9s: %6.2f ns, beyond %llu pages (%llu kB)\n",
+	       level < 3 ? level_name[level] : "walk+", ref,
+	       (unsigned long long)reach, (unsigned long long)(reach * page >> 10));
+}
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
+/* Evicts the <count> lines designated by <ptrs> from all cache levels.
+ * Returns zero if the CPU does not provide a flush instruction.
+ */
+static int flush_lines(void **ptrs, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+#if defined(__CLFLUSHOPT__)
+		_mm_clflushopt(ptrs[i]);
+#elif defined(__SSE2__)
+		_mm_clflush(ptrs[i]);
+#elif defined(__aarch64__)
+		asm volatile("dc civac, %0" : : "r" (ptrs[i]) : "memory");
+#endif
+	}
+#if defined(__SSE2__)
+	_mm_mfence();
+	return 1;
+#elif defined(__aarch64__)
+	asm volatile("dsb ish" : : : "memory");
+	return 1;
+#else
+	return 0;
+#endif
+}
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
+/* compares two uint32_t for qsort() */
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
 
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
-			ofs0 = *(uint64_t *)(area + ofs0);
-			ofs1 = *(uint64_t *)(area + ofs1);
+	return (x > y) - (x < y);
+}
+
+/* Measures the latency of each of the first <count> accesses of the single
+ * pointer chain covering <size> bytes of area <area>, in three situations:
+ * after flushing the lines to be visited from the caches ("flush", TLBs remain
+ * warm), after reading a COLD_EVICT_SIZE buffer made of 4kB pages, which also
+ * evicts the TLB entries and paging structures ("evict"), and right after the
+ * previous walk ("warm"). Each access is timed individually using the cycle
+ * counter, and trials are repeated for about <usec> microseconds per column
+ * (at least 8 times). The reported value is the median across trials. When
+ * the CPU does not provide a flush instruction, the eviction is used instead.
+ */
+static void cold_probe(void *area, unsigned int usec, size_t size, unsigned int count, int quiet)
+{
+	static const char *cold_name[] = { "flush", "evict", "warm" };
+	static uint32_t samples[3][COLD_MAX][COLD_MAX_TRIALS];
+	unsigned int trials[3];
+	void *ptrs[COLD_MAX];
+	double ratio, sum[3] = { 0 };
+	uint64_t prev, now, ovh, start;
+	unsigned int i, t, mode;
+	char *evict;
+	void **p;
+
+	if (count > COLD_MAX)
+		count = COLD_MAX;
+
+	while (size & (size - 1))
+		size &= size - 1;
+
+	prepare_area(area, size, 4); /* 1xPTR */
+
+	/* the lines read by the first <count> accesses */
+	for (p = area, i = 0; i < count; i++) {
+		ptrs[i] = p;
+		p = *p;
+	}
+
+	/* 4kB pages so that reading it evicts as many TLB entries as possible */
+	evict = mmap(NULL, COLD_EVICT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (evict == MAP_FAILED) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+#ifdef MADV_NOHUGEPAGE
+	madvise(evict, COLD_EVICT_SIZE, MADV_NOHUGEPAGE);
+#endif
+	memset(evict, 1, COLD_EVICT_SIZE);
+
+	/* the cost of reading the counter alone is subtracted */
+	for (ovh = ~0ULL, i = 0; i < 1000; i++) {
+		prev = read_cycles();
+		now = read_cycles();
+		if (now - prev < ovh)
+			ovh = now - prev;
+	}
+	ratio = cycles_per_usec();
+
+	for (mode = 0; mode < 3; mode++) {
+		start = rdtsc();
+		for (t = 0; t < COLD_MAX_TRIALS && (t < 8 || rdtsc() - start < usec); t++) {
+			if (mode == 1 || (mode == 0 && !flush_lines(ptrs, count))) {
+				size_t ofs;
+
+				for (ofs = 0; ofs < COLD_EVICT_SIZE; ofs += 64)
+					asm volatile("" : : "r" (*(volatile char *)(evict + ofs)));
+			}
+
+			p = area;
+			prev = read_cycles();
+			for (i = 0; i < count; i++) {
+				p = *p;
+				/* the counter must be read after the load */
+				asm volatile("" : "+r" (p) : : "memory");
+				now = read_cycles();
+				samples[mode][i][t] = (now - prev > ovh) ? now - prev - ovh : 0;
+				prev = now;
+			}
 		}
-		asm("" :: "r"(ofs0));
-		asm("" :: "r"(ofs1));
+		trials[mode] = t;
+	}
+	munmap(evict, COLD_EVICT_SIZE);
+
+	if (!quiet) {
+		printf(" access:");
+		for (mode = 0; mode < 3; mode++)
+			printf("%6s", cold_name[mode]);
+		printf("  (ns, median of %u/%u/%u trials)\n", trials[0], trials[1], trials[2]);
+	}
+
+	for (i = 0; i < count; i++) {
+		printf(quiet ? "%6u " : "%6u: ", i + 1);
+		for (mode = 0; mode < 3; mode++) {
+			double lat;
+
+			qsort(samples[mode][i], trials[mode], sizeof(uint32_t), cmp_u32);
+			lat = samples[mode][i][trials[mode] / 2] / ratio * 1000.0;
+			sum[mode] += lat;
+			print_lat(lat);
+		}
+		printf("\n");
+	}
+
+	if (!quiet) {
+		printf("    avg: ");
+		for (mode = 0; mode < 3; mode++)
+			print_lat(sum[mode] / count);
+		printf("\n");
 	}
-	return rounds;
 }
 
+/* compares two uint64_t for qsort() */
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
 
-/*****************************************************************************
- *                                 measurements                              *
- *****************************************************************************/
+	return (x > y) - (x < y);
+}
 
-/* returns a timestamp in microseconds */
-static inline uint64_t rdtsc()
+/* Detects stalls by walking the single pointer chain covering <size> bytes of
+ * area <area> (cached or not depending on the size) one access at a time for
+ * <usec> microseconds of CPU time, while pinned to the current CPU. Each access
+ * is timed with the cycle counter, and those taking more than <thres_ns>
+ * nanoseconds are recorded with their date. The report shows a histogram of
+ * stall durations per power of two, the longest stalls, and the periods most
+ * often observed between consecutive stalls (within 5%), which reveal
+ * recurring causes such as DRAM refresh, SMIs or hypervisor ticks.
+ */
+static void hiccup_probe(void *area, unsigned int usec, size_t size, unsigned int thres_ns, int quiet)
 {
-#ifdef CLOCK_MONOTONIC
-	struct timespec tv;
-	clock_gettime(CLOCK_MONOTONIC, &tv);
-	return (tv.tv_sec * 1000000000ULL + tv.tv_nsec) / 1000ULL;
-#else
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+	static uint64_t date[HICCUP_MAX], dur[HICCUP_MAX];
+	uint64_t hist[64] = { 0 };
+	uint64_t start, prev, now, thres, iters = 0, total = 0, nbev = 0;
+	uint64_t *ival, top[HICCUP_TOP][2];
+	uint64_t used[HICCUP_PERIODS][2];
+	uint64_t i, j, best, best_i, best_j;
+	double ratio;
+	int b, per;
+	void **p;
+
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(sched_getcpu(), &cpus);
+	sched_setaffinity(0, sizeof(cpus), &cpus);
 #endif
+	while (size & (size - 1))
+		size &= size - 1;
+
+	prepare_area(area, size, 4); /* 1xPTR */
+	ratio = cycles_per_usec();
+	thres = thres_ns * ratio / 1000.0;
+
+	set_alarm(usec);
+	p = area;
+	start = prev = read_cycles();
+	while (!stop_now) {
+		p = *p;
+		/* the counter must be read after the load */
+		asm volatile("" : "+r" (p) : : "memory");
+		now = read_cycles();
+		if (now - prev > thres) {
+			if (nbev < HICCUP_MAX) {
+				date[nbev] = prev - start;
+				dur[nbev++] = now - prev;
+			}
+			total++;
+		}
+		prev = now;
+		iters++;
+	}
+	set_alarm(0);
+
+	printf("%llu accesses in %.0f us, %.2f ns avg, %llu stalls above %u ns",
+	       (unsigned long long)iters, (prev - start) / ratio,
+	       (prev - start) / ratio * 1000.0 / (iters ? iters : 1),
+	       (unsigned long long)total, thres_ns);
+	if (total > nbev)
+		printf(" (%llu recorded)", (unsigned long long)nbev);
+	printf("\n");
+
+	if (!nbev)
+		return;
+
+	/* histogram per power of two of nanoseconds */
+	for (i = 0; i < nbev; i++) {
+		uint64_t ns = dur[i] * 1000.0 / ratio;
+
+		for (b = 0; b < 63 && ns >> (b + 1); b++)
+			;
+		hist[b]++;
+	}
+
+	if (!quiet)
+		printf("\n  duration_ns:    count\n");
+	for (b = 0; b < 64; b++) {
+		if (!hist[b])
+			continue;
+		printf(quiet ? "%13llu %8llu\n" : "%13llu: %8llu\n",
+		       1ULL << b, (unsigned long long)hist[b]);
+	}
+
+	/* longest stalls, as date and duration */
+	memset(top, 0, sizeof(top));
+	for (i = 0; i < nbev; i++) {
+		for (j = HICCUP_TOP; j > 0 && dur[i] > top[j - 1][1]; j--) {
+			if (j < HICCUP_TOP) {
+				top[j][0] = top[j - 1][0];
+				top[j][1] = top[j - 1][1];
+			}
+		}
+		if (j < HICCUP_TOP) {
+			top[j][0] = date[i];
+			top[j][1] = dur[i];
+		}
+	}
+
+	if (!quiet)
+		printf("\n      date_us:   dur_ns\n");
+	for (j = 0; j < HICCUP_TOP && top[j][1]; j++)
+		printf(quiet ? "%13.1f %8.0f\n" : "%13.1f: %8.0f\n",
+		       top[j][0] / ratio, top[j][1] * 1000.0 / ratio);
+
+	if (nbev < 3)
+		return;
+
+	/* intervals between consecutive stalls, sorted. The most common period
+	 * is the one with the largest number of intervals within 5% of the
+	 * lowest one, and is reported by its median. Next ones are searched in
+	 * the remaining ranges.
+	 */
+	ival = malloc((nbev - 1) * sizeof(*ival));
+	if (!ival) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+	for (i = 0; i < nbev - 1; i++)
+		ival[i] = date[i + 1] - date[i];
+	qsort(ival, nbev - 1, sizeof(*ival), cmp_u64);
+
+	if (!quiet)
+		printf("\n    period_us:    count\n");
+	for (per = 0; per < HICCUP_PERIODS; per++) {
+		best = best_i = best_j = 0;
+		for (i = j = 0; i < nbev - 1; i++) {
+			if (j < i)
+				j = i;
+			while (j < nbev - 1 && ival[j] <= ival[i] + ival[i] / 20)
+				j++;
+			/* skip ranges overlapping already reported periods */
+			for (b = 0; b < per; b++)
+				if (i < used[b][1] && j > used[b][0])
+					break;
+			if (b == per && j - i > best) {
+				best = j - i;
+				best_i = i;
+				best_j = j;
+			}
+		}
+		/* a single interval is not a period */
+		if (best < 2)
+			break;
+		used[per][0] = best_i;
+		used[per][1] = best_j;
+		printf(quiet ? "%13.2f %8llu\n" : "%13.2f: %8llu\n",
+		       ival[(best_i + best_j) / 2] / ratio, (unsigned long long)best);
+	}
+	free(ival);
 }
 
-/* just marks the alarm as received */
-void alarm_handler(int sig)
+#if defined(__linux__) && defined(CPU_COUNT)
+/* Parses a sysfs CPU list such as "0-3,8-11" into <set>. Returns non-zero on
+ * success, or zero if the file cannot be read or is empty.
+ */
+static int read_cpulist(const char *path, cpu_set_t *set)
 {
-	stop_now = 1;
+	char buf[1024];
+	char *next, *end;
+	long first, last;
+	FILE *f;
+
+	CPU_ZERO(set);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	next = fgets(buf, sizeof(buf), f);
+	fclose(f);
+
+	while (next && *next >= '0' && *next <= '9') {
+		first = last = strtol(next, &end, 10);
+		if (*end == '-')
+			last = strtol(end + 1, &end, 10);
+		while (first <= last && first < CPU_SETSIZE)
+			CPU_SET(first++, set);
+		next = (*end == ',') ? end + 1 : NULL;
+	}
+	return CPU_COUNT(set) > 0;
 }
 
-/* sets an alarm to trigger after <usec> microseconds. 0 disables it */
-void set_alarm(unsigned int usec)
+/* Adds group <set> named <prefix><num> unless already known. The group is
+ * restricted to the CPUs we're allowed to run on, and dropped if it becomes
+ * empty.
+ */
+static void add_cpu_group(const char *prefix, int num, cpu_set_t *set, const cpu_set_t *allowed)
 {
-	struct itimerval timer = {
-		.it_value.tv_usec = usec % 1000000,
-		.it_value.tv_sec  = usec / 1000000,
-	};
+	int grp;
 
-	if (usec) {
-		stop_now = 0;
-		signal(SIGALRM, alarm_handler);
-		signal(SIGVTALRM, alarm_handler);
-	}
-	setitimer(ITIMER_VIRTUAL, &timer, NULL);
+	CPU_AND(set, set, allowed);
+	if (!CPU_COUNT(set) || nbgroups >= MAX_GROUPS)
+		return;
+
+	for (grp = 0; grp < nbgroups; grp++)
+		if (CPU_EQUAL(set, &groups[grp].cpus))
+			return;
+
+	snprintf(groups[nbgroups].name, sizeof(groups[nbgroups].name), "%s%d", prefix, num);
+	groups[nbgroups].cpus = *set;
+	nbgroups++;
 }
 
-/* Randomly accesses aligned words using function #<fct> over <size> bytes of
- * area <area> for about <usec> microseconds, then returns the number of words
- * read per microsecond. Note: size is rounded down to the lower power of two,
- * and must be at least 4kB.
+/* Enumerates memory nodes then CPU clusters (e.g. big.LITTLE) among the CPUs
+ * in <allowed>. Nodes are named "n<node>", clusters "c<first_cpu>". Clusters
+ * matching a node are not repeated.
  */
-unsigned int random_read_over_area(void *area, unsigned int usec, size_t size, int fct)
+static void detect_cpu_groups(const cpu_set_t *allowed)
 {
-	uint64_t rounds;
-	uint64_t before, after;
-	unsigned int word;
+	char path[128];
+	cpu_set_t set;
+	int nodes = 0;
+	int node, cpu;
+
+	for (node = 0; node < MAX_GROUPS; node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		if (read_cpulist(path, &set)) {
+			add_cpu_group("n", node, &set, allowed);
+			nodes++;
+		}
+	}
 
-	if (fct >= sizeof(run) / sizeof(*run))
-		return 0;
+	if (!nodes) {
+		set = *allowed;
+		add_cpu_group("n", 0, &set, allowed);
+	}
 
-	if (!run[fct])
-		return 0;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, allowed))
+			continue;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/cluster_cpus_list", cpu);
+		if (!read_cpulist(path, &set)) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/related_cpus", cpu);
+			if (!read_cpulist(path, &set))
+				continue;
+		}
+		/* name the cluster after its first CPU */
+		for (node = 0; node < CPU_SETSIZE && !CPU_ISSET(node, &set); node++)
+			;
+		add_cpu_group("c", node, &set, allowed);
+	}
+}
 
-	word = run[fct](NULL);
+/* Measures the latency of function #<fct> over <size> bytes for each pair of
+ * CPU groups, with the area allocated and filled (hence first touched) from
+ * the group of the row, then walked from the group of the column. Each measure
+ * lasts <usec> microseconds. Results are reported in nanoseconds per access.
+ */
+static void latency_matrix(unsigned int usec, size_t size, int fct, int quiet)
+{
+	cpu_set_t allowed;
+	void *area;
+	int mem, cpu;
 
-	if (word & 256)
-		fill_area_ptr(area, size);
-	else {
-		if ((word & 255) == 4)
-			fill_area_32(area, size);
-		else if ((word & 255) == 8)
-			fill_area_64(area, size);
-		else
-			abort();
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		perror("sched_getaffinity");
+		exit(1);
 	}
 
-	set_alarm(usec);
-	after = rdtsc();
-	before = rdtsc();
-	before += before - after; // compensate for the syscall time
+	detect_cpu_groups(&allowed);
 
-	rounds = run[fct](area);
+	if (!quiet) {
+		printf("mem\\cpu");
+		for (cpu = 0; cpu < nbgroups; cpu++)
+			printf("%6s", groups[cpu].name);
+		printf("\n");
+	}
 
-	after = rdtsc();
-	set_alarm(0);
+	for (mem = 0; mem < nbgroups; mem++) {
+		/* the area is mapped, filled and released while running on the
+		 * memory group so that the first touch places it there.
+		 */
+		if (sched_setaffinity(0, sizeof(groups[mem].cpus), &groups[mem].cpus) != 0) {
+			perror("sched_setaffinity");
+			exit(1);
+		}
 
-	/* speed = transactions per millisecond. Use 64-bit computations to avoid
-	 * overflows. The caller can turn this into bytes per second by multiplying
-	 * by <word>.
-	 */
-	usec = after - before;
-	if (usec < 1)
-		usec = 1;
-	rounds *= LOOPS_PER_ROUND;
-	return rounds * 1000ULL / usec;
+		area = alloc_area(size);
+		if (!area) {
+			printf("Failed to allocate memory\n");
+			exit(1);
+		}
+
+		prepare_area(area, size, fct);
+
+		printf(quiet ? "%6s " : "%6s: ", groups[mem].name);
+		for (cpu = 0; cpu < nbgroups; cpu++) {
+			sched_setaffinity(0, sizeof(groups[cpu].cpus), &groups[cpu].cpus);
+			print_lat(1000000.0 / walk_area(area, usec, run[fct]));
+			fflush(stdout);
+		}
+		printf("\n");
+		free_area(area, size);
+	}
+
+	sched_setaffinity(0, sizeof(allowed), &allowed);
 }
+#endif
 
 int main(int argc, char **argv)
 {
@@ -654,10 +2690,21 @@ int main(int argc, char **argv)
 	size_t size, size_max;
 	void *area;
 	unsigned int cols = 0;
-	unsigned int wins = 0;
+	uint64_t wins = 0;
 	unsigned int ret, word;
 	int quiet = 0;
 	int slowstart = 0;
+	int geometry = 0;
+	int matrix = 0;
+	int strides = 0;
+	int tlb = 0;
+	int gather = -1;
+	int split = 0;
+	unsigned int hiccup = 0;
+	unsigned int cold = 0;
+	unsigned int dists[9] = { 0 };
+	unsigned int objs[17] = { 0 };
+	unsigned int widths[17] = { 0 };
 	int fmt = 0;
 	int fct;
 
@@ -674,6 +2721,53 @@ int main(int argc, char **argv)
 		else if (strcmp(argv[1], "-b") == 0) {
 			fmt = 1;
 		}
+		else if (argc > 2 && strcmp(argv[1], "-B") == 0) {
+			if (strcmp(argv[2], "4k") == 0)
+				backing = BACK_4K;
+			else if (strcmp(argv[2], "thp") == 0)
+				backing = BACK_THP;
+			else if (strcmp(argv[2], "huge") == 0)
+				backing = BACK_HUGETLB;
+			else {
+				fprintf(stderr, "Unknown backing '%s', must be 4k, thp or huge.\n", argv[2]);
+				exit(1);
+			}
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-C") == 0) {
+			cold = atoi(argv[2]);
+			if (cold < 1 || cold > COLD_MAX) {
+				fprintf(stderr, "Invalid number of cold accesses, accepted range is 1..%d.\n", COLD_MAX);
+				exit(1);
+			}
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-d") == 0) {
+			dirty_first = 1;
+		}
+		else if (strcmp(argv[1], "-g") == 0) {
+			geometry = 1;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-G") == 0) {
+			if (strcmp(argv[2], "uni") == 0)
+				gather = GT_UNI;
+			else if (strcmp(argv[2], "seq") == 0)
+				gather = GT_SEQ;
+			else if (strcmp(argv[2], "page") == 0)
+				gather = GT_PAGE;
+			else if (strcmp(argv[2], "skew") == 0)
+				gather = GT_SKEW;
+			else {
+				fprintf(stderr, "Unknown distribution '%s', must be uni, seq, page or skew.\n", argv[2]);
+				exit(1);
+			}
+			argc--; argv++;
+		}
+#if defined(__linux__) && defined(CPU_COUNT)
+		else if (strcmp(argv[1], "-m") == 0) {
+			matrix = 1;
+		}
+#endif
 		else if (strcmp(argv[1], "-n") == 0) {
 			fmt = 2;
 		}
@@ -694,6 +2788,79 @@ int main(int argc, char **argv)
 			}
 			argc--; argv++;
 		}
+		else if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+			hiccup = atoi(argv[2]);
+			if (!hiccup) {
+				fprintf(stderr, "Invalid stall threshold, must be at least 1 ns.\n");
+				exit(1);
+			}
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-i") == 0) {
+			/* -i width[,...] */
+			char *next = argv[2];
+			char *end;
+			int nbw = 0;
+			int width;
+
+			while (*next && nbw < 16) {
+				width = strtol(next, &end, 0);
+				if (width < 1 || width > LK_MAX_WIDTH || (*end != '\0' && *end != ','))
+					break;
+				widths[nbw++] = width;
+				if (*end == ',')
+					end++;
+				next = end;
+			}
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-O") == 0) {
+			/* -O objsize[,...] */
+			char *next = argv[2];
+			char *end;
+			int nbo = 0;
+			int obj;
+
+			while (*next && nbo < 16) {
+				obj = strtol(next, &end, 0);
+				if (obj < 64 || obj > 65536 || (obj & (obj - 1)) ||
+				    (*end != '\0' && *end != ','))
+					break;
+				objs[nbo++] = obj;
+				if (*end == ',')
+					end++;
+				next = end;
+			}
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-p") == 0) {
+			strides = 1;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-P") == 0) {
+			/* -P dist[,...] */
+			char *next = argv[2];
+			char *end;
+			int nbd = 0;
+			int dist;
+
+			strides = 1;
+			while (*next && nbd < 8) {
+				dist = strtol(next, &end, 0);
+				if (dist <= 0 || (*end != '\0' && *end != ','))
+					break;
+				dists[nbd++] = dist;
+				if (*end == ',')
+					end++;
+				next = end;
+			}
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-T") == 0) {
+			tlb = 1;
+		}
+		else if (strcmp(argv[1], "-u") == 0) {
+			split = 1;
+		}
 		else if (argc > 1 && strcmp(argv[1], "-w") == 0) {
 			/* -w size[,...] */
 			char *next = argv[2];
@@ -702,11 +2869,11 @@ int main(int argc, char **argv)
 
 			while (*next) {
 				win = strtol(next, &end, 0);
-				if ((win < 12 || win > 31) || (*end != '\0' && *end != ','))
+				if ((win < 12 || win > MAX_SIZE_BITS) || (*end != '\0' && *end != ','))
 					break;
-				if ((1U << win) > size_max)
-					size_max = 1U << win;
-				wins |= 1U << win;
+				if (((size_t)1 << win) > size_max)
+					size_max = (size_t)1 << win;
+				wins |= 1ULL << win;
 				if (*end == ',')
 					end++;
 				next = end;
@@ -717,13 +2884,35 @@ int main(int argc, char **argv)
 			fprintf(stderr,
 				"Usage: prog [options]* <time_ms> <area_kB>\n"
 				"  -b          report equivalent bandwidth in MB/s\n"
+				"  -B <back>   page backing : 4k, thp, huge (hugetlbfs) (def: system's)\n"
 				"  -c <cols>   only emit these columns (1..N, ...)\n"
+				"  -C <n>      time each of the first n accesses after flushing caches and\n"
+				"              TLBs, over <area_kB> (1..%d) instead\n"
+				"  -d          keep the whole area dirty: rewrite it before each 1/%d of a\n"
+				"              measure\n"
+				"  -g          probe cache geometry (line size and ways) instead\n"
+				"  -G <dist>   compare scalar loads and SIMD gathers instead, using this index\n"
+				"              distribution : uni, seq, page (4kB local), skew (power law)\n"
+				"  -i <widths> compare latency hiding techniques for independent lookups\n"
+				"              at these interleave widths (1..%d, ...) over <area_kB>\n"
+				"  -j <ns>     detect stalls longer than this while walking <area_kB> for\n"
+				"              <time_ms>, pinned to the current CPU, instead\n"
+#if defined(__linux__) && defined(CPU_COUNT)
+				"  -m          report a memory node/cluster x CPU node/cluster latency\n"
+				"              matrix at <area_kB> for the first selected column\n"
+#endif
 				"  -n          report output in nanosecond per access\n"
+				"  -O <sizes>  read whole objects of these sizes per hop (64..65536, ...)\n"
+				"  -p          measure latency at constant strides (prefetchers) instead\n"
+				"  -P <dists>  like -p, and add sw prefetch this many strides ahead (1..N, ...)\n"
 				"  -s          slowstart : pre-heat for 500ms to let cpufreq adapt\n"
-				"  -w <sizes>  only test at these power of 2 sizes (12..31, ...)\n"
+				"  -T          measure TLB reach with one line per page (see -B) instead\n"
+				"  -u          measure words split across lines and pages over <area_kB>\n"
+				"              at each offset instead\n"
+				"  -w <sizes>  only test at these power of 2 sizes (12..%d, ...)\n"
 				"  -q          quiet : don't show column headers\n"
 				"  -h          show this help\n"
-				"");
+				"", COLD_MAX, DIRTY_SLICES, LK_MAX_WIDTH, MAX_SIZE_BITS);
 			exit(!!strcmp(argv[1], "-h"));
 		}
 		argc--;
@@ -737,7 +2926,7 @@ int main(int argc, char **argv)
 		size_max = 16 * 1048576;
 
 	if (argc > 2)
-		size_max = atol(argv[2]) * 1024;
+		size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
 
 	run[0] = run_1w32_generic;  name[0] = "1x32";
 	run[1] = run_2w32_generic;  name[1] = "2x32";
@@ -747,8 +2936,13 @@ int main(int argc, char **argv)
 	run[5] = run_2ptr_generic;  name[5] = "2xPTR";
 	run[6] = run_4ptr_generic;  name[6] = "4xPTR";
 	run[7] = run_8ptr_generic;  name[7] = "8xPTR";
+	run[8] = run_1rmw_generic;  name[8] = "1xRMW";
+	run[9] = run_2rmw_generic;  name[9] = "2xRMW";
+	run[10] = run_4rmw_generic; name[10] = "4xRMW";
 
-	if (posix_memalign(&area, size_max / 4, size_max) != 0 || !area) {
+	/* the split sweep's last word may cross the end of the area */
+	area = alloc_area(size_max + (split ? 8 : 0));
+	if (!area) {
 		printf("Failed to allocate memory\n");
 		exit(1);
 	}
@@ -760,6 +2954,63 @@ int main(int argc, char **argv)
 		set_alarm(0);
 	}
 
+	if (geometry) {
+		geometry_probe(area, usec, size_max, quiet);
+		exit(0);
+	}
+
+	if (*widths) {
+		lookup_sweep(area, usec, size_max, widths, fmt, quiet);
+		exit(0);
+	}
+
+	if (hiccup) {
+		hiccup_probe(area, usec, size_max, hiccup, quiet);
+		exit(0);
+	}
+
+	if (split) {
+		split_sweep(area, usec, size_max, fmt, quiet);
+		exit(0);
+	}
+
+	if (cold) {
+		cold_probe(area, usec, size_max, cold, quiet);
+		exit(0);
+	}
+
+	if (gather >= 0) {
+		gather_sweep(area, usec, size_max, wins, gather, fmt, quiet);
+		exit(0);
+	}
+
+	if (*objs) {
+		object_sweep(area, usec, size_max, wins, objs, fmt, quiet);
+		exit(0);
+	}
+
+	if (tlb) {
+		tlb_probe(area, usec, size_max, quiet);
+		exit(0);
+	}
+
+	if (strides) {
+		stride_sweep(area, usec, size_max, dists, quiet);
+		exit(0);
+	}
+
+#if defined(__linux__) && defined(CPU_COUNT)
+	if (matrix) {
+		/* use the first selected column, or 1xPTR by default */
+		for (fct = 0; run[fct] && cols && !(cols & (1 << fct)); fct++)
+			;
+		if (!cols || !run[fct])
+			fct = 4;
+		latency_matrix(usec, size_max, fct, quiet);
+		exit(0);
+	}
+#endif
+
 	if (!quiet) {
 		int field;
 
@@ -779,31 +3030,14 @@ int main(int argc, char **argv)
 	for (size = 4096; size <= size_max || size <= wins; size *= 2) {
 		if (wins && !(wins & size))
 			continue;
-		printf(quiet ? "%6u " : "%6uk: ", (unsigned int)(size >> 10U));
+		printf(quiet ? "%6llu " : "%6lluk: ", (unsigned long long)(size >> 10U));
 		for (fct = 0; run[fct]; fct++) {
 			if (cols && !(cols & (1 << fct)))
 				continue;
 			ret = random_read_over_area(area, usec, size, fct);
-			if (fmt == 1) {
-				/* bandwidth in MB/s */
-				word = run[fct](NULL);
-				word = (word & 255) * (((word >> 16) & 255) + 1);
-				printf("%5u ", ret * word / 1024U);
-			} else if (fmt == 2) {
-				/* nanoseconds per access */
-				double lat = 1000000.0 / ret;
-				if (lat < 10.0)
-					printf("%1.3f ", lat);
-				else if (lat < 100.0)
-					printf("%2.2f ", lat);
-				else if (lat < 1000.0)
-					printf("%3.1f ", lat);
-				else
-					printf("%4.0f ", lat);
-			} else {
-				/* accesses per millisecond */
-				printf("%7u ", ret);
-			}
+			word = run[fct](NULL);
+			word = (word & 255) * (((word >> 16) & 255) + 1);
+			print_result(ret, word, fmt);
 		}
 		printf("\n");
 	}
@@ -1,18 +1,167 @@
+/* for memrchr() and sched_setaffinity() */
+#define _GNU_SOURCE
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#ifdef __SSE2__
+#include <x86intrin.h>
+#endif
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <pthread.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define HAS_REP_MOVSB 1
+#else
+#define HAS_REP_MOVSB 0
+#endif
+
+/* smallest and default largest sizes in bytes for the size sweeps */
+#define MIN_SIZE      16
+#define DEFAULT_SIZE  (256 * 1048576)
+
+/* max number of sizes of the alignment matrix */
+#define MAX_ALIGN_SIZES 16
+
+/* size distributions: max number of entries, number of copies replayed in
+ * loop, and default size of the source and destination pools.
+ */
+#define MAX_DIST_ENTRIES 256
+#define DIST_OPS         16384
+#define DEFAULT_POOL     (256 * 1024)
+
+/* scan suite: default delimiter and byte set searched */
+#define SCAN_CHAR        ','
+#define SCAN_SET         " \t\r\n,;:\""
+
+/* scan suite: the scanned functions */
+enum {
+	SCAN_CHR = 0,
+	SCAN_RCHR,
+	SCAN_LEN,
+	SCAN_CMP,
+	SCAN_SET_FIND,
+	SCAN_FUNCS
+};
+
+/* multi-threaded mode: kernels besides the scan functions, and max threads */
+#define KERN_COPY        SCAN_FUNCS
+#define KERN_SET         (SCAN_FUNCS + 1)
+#define MAX_THREADS      1024
+#define MIN_THREAD_SIZE  (1024 * 1024)
+
+/* zero-copy mode: pipe size requested for vmsplice() */
+#define ZC_PIPE_SIZE     (1024 * 1024)
+
 static unsigned int unalign;
 
+/* comma-separated names of the implementations to test, NULL=all */
+static const char *impl_list;
+
 struct test_fct {
 	const char *name;
 	unsigned int (*f)(unsigned int, unsigned int);
 };
 
+/* a range of sizes from a distribution, picked with weight <weight> */
+struct dist_entry {
+	unsigned int min, max;
+	unsigned int weight;
+};
+
+/* a copy replayed from a distribution */
+struct copy_op {
+	uint32_t src, dst;
+	uint32_t len;
+};
+
+/* built-in size distributions, in the same format as the files */
+static const struct {
+	const char *name;
+	const char *hist;
+} dist_presets[] = {
+	{ "rpc",   "8-16 40\n17-64 35\n65-256 20\n257-512 5\n" },
+	{ "uni",   "8-512 1\n" },
+	{ "tiny",  "1-32 1\n" },
+	{ "pow2",  "8 1\n16 1\n32 1\n64 1\n128 1\n256 1\n512 1\n" },
+	{ NULL, NULL }
+};
+
+/* state shared by the large transfer mechanisms. <src> and <dst> are
+ * anonymous mappings of at least <size> bytes. Each mechanism measures its
+ * own loop so that setup costs (fork, pipes, threads) are not accounted.
+ */
+struct zc_ctx {
+	char *src, *dst;
+	size_t size;
+	unsigned long long wall0, wall;  // wall clock time, usec
+	unsigned long long cpu0, cpu;    // CPU time of all threads, usec
+	int pipefd[2];
+	int memfd;                       // memfd the consumer maps, or -1
+	int cons_cpu;                    // CPU the consumer thread runs on
+	char *xfer;                      // area handed over to the consumer
+	volatile unsigned int sent, done; // handoffs sent and acknowledged
+	volatile int stop, failed;       // consumer must stop / has failed
+};
+
+/* a mechanism moving <size> bytes from <src> to <dst> during <usec>
+ * microseconds, returning the number of bytes moved or 0 if unsupported.
+ */
+struct zc_mech {
+	const char *name;
+	uint64_t (*run)(struct zc_ctx *ctx, unsigned int usec);
+};
+
+/* a strategy making <size> bytes at <area> reusable, returning the area to
+ * use, or NULL on failure.
+ */
+struct reclaim_strat {
+	const char *name;
+	char *(*reset)(char *area, size_t size);
+};
+
+/* names of the scan functions, also used to select the threaded kernel */
+static const char *const scan_names[SCAN_FUNCS] = {
+	"memchr", "memrchr", "strlen", "memcmp", "findset"
+};
+
+/* a set of bytes for the multi-byte search: the NUL-terminated list for
+ * strcspn(), a bitmap, and the nibble tables for the shuffle-based lookups.
+ * A byte b is in the set if lo[b & 15] & hi[b >> 4] is not zero.
+ */
+struct byteset {
+	uint8_t lo[16], hi[16];
+	uint8_t map[32];
+	const char *str;
+} __attribute__((aligned(16)));
+
+/* an implementation of memcpy() and memset() */
+struct copy_impl {
+	const char *name;
+	void (*copy)(void *dst, const void *src, size_t len);
+	void (*set)(void *dst, int c, size_t len);
+};
+
 
 #if (_POSIX_MEMORY_PROTECTION - 0 < 200112L)
 static inline int posix_memalign(void **memptr, size_t alignment, size_t size)
@@ -41,8 +190,11 @@ unsigned int bench_memcpy(unsigned int loop, unsigned int size)
 	unsigned int i;
 	void *src, *dst;
 
-	posix_memalign(&src, 64, size);
-	posix_memalign(&dst, 64, size + unalign);
+	if (posix_memalign(&src, 64, size) != 0 ||
+	    posix_memalign(&dst, 64, size + unalign) != 0) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
 
 	/* ensure the pages are allocated */
 	memset(src, 0, size);
@@ -107,8 +259,10 @@ unsigned int bench_memchr(unsigned int loop, unsigned int size)
 
 	before = rdtsc();
 	for (i = 0; i < loop; i++) {
-		if (memchr(dst, i|1, size))
+		if (memchr(dst, i|1, size)) {
+			free(dst);
 			return 0;
+		}
 		asm("" ::: "memory");
 	}
 
@@ -238,29 +392,2513 @@ static struct test_fct test_fcts[] = {
 	{ NULL, NULL }
 };
 
-void run_bench(unsigned int loop, unsigned int size)
+/*****************************************************************************
+ *                           copy/set implementations                        *
+ *****************************************************************************/
+
+/* All implementations support any length and alignment. They process the bulk
+ * with their largest word, then finish with the last word overlapping the
+ * previous ones, or with a smaller implementation for short lengths.
+ */
+
+/* copies less than 64 bytes using overlapping 8, 4 and 1-byte words */
+static inline void copy_small(void *dst, const void *src, size_t len)
 {
-	unsigned int usecs;
-	struct test_fct *t = test_fcts;
+	uint64_t a, b;
+	uint32_t c, d;
+	size_t ofs;
 
-	printf("Running tests with %d loops of %d bytes\n", loop, size);
+	if (len >= 8) {
+		for (ofs = 0; ofs + 8 < len; ofs += 8) {
+			memcpy(&a, src + ofs, 8);
+			memcpy(dst + ofs, &a, 8);
+		}
+		memcpy(&b, src + len - 8, 8);
+		memcpy(dst + len - 8, &b, 8);
+	}
+	else if (len >= 4) {
+		memcpy(&c, src, 4);
+		memcpy(&d, src + len - 4, 4);
+		memcpy(dst, &c, 4);
+		memcpy(dst + len - 4, &d, 4);
+	}
+	else {
+		for (ofs = 0; ofs < len; ofs++)
+			((char *)dst)[ofs] = ((const char *)src)[ofs];
+	}
+}
 
-	while (t->name && t->f) {
-		usecs = t->f(loop, size);
-		printf("%s: %d us for %d loops of %d bytes = %lld kB/s\n",
-		       t->name,
-		       usecs, loop, size, (unsigned long long)1024ULL * loop * size / usecs);
-		t++;
+/* sets less than 64 bytes using overlapping 8, 4 and 1-byte words */
+static inline void set_small(void *dst, int c, size_t len)
+{
+	uint64_t a = 0x0101010101010101ULL * (unsigned char)c;
+	size_t ofs;
+
+	if (len >= 8) {
+		for (ofs = 0; ofs + 8 < len; ofs += 8)
+			memcpy(dst + ofs, &a, 8);
+		memcpy(dst + len - 8, &a, 8);
+	}
+	else if (len >= 4) {
+		memcpy(dst, &a, 4);
+		memcpy(dst + len - 4, &a, 4);
+	}
+	else {
+		for (ofs = 0; ofs < len; ofs++)
+			((char *)dst)[ofs] = c;
 	}
 }
 
-main(int argc, char **argv)
+static void copy_libc(void *dst, const void *src, size_t len)
 {
-	unsigned int size;
-	unsigned int loop;
+	memcpy(dst, src, len);
+}
 
-	loop = 10;
-	size = 16777216;
+static void set_libc(void *dst, int c, size_t len)
+{
+	memset(dst, c, len);
+}
+
+#if HAS_REP_MOVSB
+/* fast with ERMS for large blocks, and with FSRM for short ones */
+static void copy_movsb(void *dst, const void *src, size_t len)
+{
+	asm volatile("rep movsb" : "+D" (dst), "+S" (src), "+c" (len) : : "memory");
+}
+
+static void set_stosb(void *dst, int c, size_t len)
+{
+	asm volatile("rep stosb" : "+D" (dst), "+c" (len) : "a" (c) : "memory");
+}
+#endif
+
+#ifdef __SSE2__
+static void copy_sse(void *dst, const void *src, size_t len)
+{
+	size_t ofs;
+
+	if (len < 16) {
+		copy_small(dst, src, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 64 <= len; ofs += 64) {
+		__m128i x0 = _mm_loadu_si128(src + ofs);
+		__m128i x1 = _mm_loadu_si128(src + ofs + 16);
+		__m128i x2 = _mm_loadu_si128(src + ofs + 32);
+		__m128i x3 = _mm_loadu_si128(src + ofs + 48);
+		_mm_storeu_si128(dst + ofs, x0);
+		_mm_storeu_si128(dst + ofs + 16, x1);
+		_mm_storeu_si128(dst + ofs + 32, x2);
+		_mm_storeu_si128(dst + ofs + 48, x3);
+	}
+	for (; ofs + 16 <= len; ofs += 16)
+		_mm_storeu_si128(dst + ofs, _mm_loadu_si128(src + ofs));
+	if (ofs < len)
+		_mm_storeu_si128(dst + len - 16, _mm_loadu_si128(src + len - 16));
+}
+
+static void set_sse(void *dst, int c, size_t len)
+{
+	__m128i x = _mm_set1_epi8(c);
+	size_t ofs;
+
+	if (len < 16) {
+		set_small(dst, c, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 64 <= len; ofs += 64) {
+		_mm_storeu_si128(dst + ofs, x);
+		_mm_storeu_si128(dst + ofs + 16, x);
+		_mm_storeu_si128(dst + ofs + 32, x);
+		_mm_storeu_si128(dst + ofs + 48, x);
+	}
+	for (; ofs + 16 <= len; ofs += 16)
+		_mm_storeu_si128(dst + ofs, x);
+	if (ofs < len)
+		_mm_storeu_si128(dst + len - 16, x);
+}
+
+/* non-temporal stores bypass the caches. The destination is aligned to 16
+ * bytes first as required by movntdq.
+ */
+static void copy_nt(void *dst, const void *src, size_t len)
+{
+	size_t ofs;
+
+	if (len < 64) {
+		copy_sse(dst, src, len);
+		return;
+	}
+
+	ofs = -(uintptr_t)dst & 15;
+	copy_small(dst, src, ofs);
+	for (; ofs + 64 <= len; ofs += 64) {
+		__m128i x0 = _mm_loadu_si128(src + ofs);
+		__m128i x1 = _mm_loadu_si128(src + ofs + 16);
+		__m128i x2 = _mm_loadu_si128(src + ofs + 32);
+		__m128i x3 = _mm_loadu_si128(src + ofs + 48);
+		_mm_stream_si128(dst + ofs, x0);
+		_mm_stream_si128(dst + ofs + 16, x1);
+		_mm_stream_si128(dst + ofs + 32, x2);
+		_mm_stream_si128(dst + ofs + 48, x3);
+	}
+	_mm_sfence();
+	if (ofs < len)
+		copy_sse(dst + ofs, src + ofs, len - ofs);
+}
+
+static void set_nt(void *dst, int c, size_t len)
+{
+	__m128i x = _mm_set1_epi8(c);
+	size_t ofs;
+
+	if (len < 64) {
+		set_sse(dst, c, len);
+		return;
+	}
+
+	ofs = -(uintptr_t)dst & 15;
+	set_small(dst, c, ofs);
+	for (; ofs + 64 <= len; ofs += 64) {
+		_mm_stream_si128(dst + ofs, x);
+		_mm_stream_si128(dst + ofs + 16, x);
+		_mm_stream_si128(dst + ofs + 32, x);
+		_mm_stream_si128(dst + ofs + 48, x);
+	}
+	_mm_sfence();
+	if (ofs < len)
+		set_sse(dst + ofs, c, len - ofs);
+}
+#endif
+
+#ifdef __AVX__
+static void copy_avx(void *dst, const void *src, size_t len)
+{
+	size_t ofs;
+
+	if (len < 32) {
+		copy_sse(dst, src, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 128 <= len; ofs += 128) {
+		__m256i y0 = _mm256_loadu_si256(src + ofs);
+		__m256i y1 = _mm256_loadu_si256(src + ofs + 32);
+		__m256i y2 = _mm256_loadu_si256(src + ofs + 64);
+		__m256i y3 = _mm256_loadu_si256(src + ofs + 96);
+		_mm256_storeu_si256(dst + ofs, y0);
+		_mm256_storeu_si256(dst + ofs + 32, y1);
+		_mm256_storeu_si256(dst + ofs + 64, y2);
+		_mm256_storeu_si256(dst + ofs + 96, y3);
+	}
+	for (; ofs + 32 <= len; ofs += 32)
+		_mm256_storeu_si256(dst + ofs, _mm256_loadu_si256(src + ofs));
+	if (ofs < len)
+		_mm256_storeu_si256(dst + len - 32, _mm256_loadu_si256(src + len - 32));
+}
+
+static void set_avx(void *dst, int c, size_t len)
+{
+	__m256i y = _mm256_set1_epi8(c);
+	size_t ofs;
+
+	if (len < 32) {
+		set_sse(dst, c, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 128 <= len; ofs += 128) {
+		_mm256_storeu_si256(dst + ofs, y);
+		_mm256_storeu_si256(dst + ofs + 32, y);
+		_mm256_storeu_si256(dst + ofs + 64, y);
+		_mm256_storeu_si256(dst + ofs + 96, y);
+	}
+	for (; ofs + 32 <= len; ofs += 32)
+		_mm256_storeu_si256(dst + ofs, y);
+	if (ofs < len)
+		_mm256_storeu_si256(dst + len - 32, y);
+}
+#endif
+
+#ifdef __AVX512F__
+static void copy_avx512(void *dst, const void *src, size_t len)
+{
+	size_t ofs;
+
+	if (len < 64) {
+		copy_avx(dst, src, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 256 <= len; ofs += 256) {
+		__m512i z0 = _mm512_loadu_si512(src + ofs);
+		__m512i z1 = _mm512_loadu_si512(src + ofs + 64);
+		__m512i z2 = _mm512_loadu_si512(src + ofs + 128);
+		__m512i z3 = _mm512_loadu_si512(src + ofs + 192);
+		_mm512_storeu_si512(dst + ofs, z0);
+		_mm512_storeu_si512(dst + ofs + 64, z1);
+		_mm512_storeu_si512(dst + ofs + 128, z2);
+		_mm512_storeu_si512(dst + ofs + 192, z3);
+	}
+	for (; ofs + 64 <= len; ofs += 64)
+		_mm512_storeu_si512(dst + ofs, _mm512_loadu_si512(src + ofs));
+	if (ofs < len)
+		_mm512_storeu_si512(dst + len - 64, _mm512_loadu_si512(src + len - 64));
+}
+
+static void set_avx512(void *dst, int c, size_t len)
+{
+	__m512i z = _mm512_set1_epi8(c);
+	size_t ofs;
+
+	if (len < 64) {
+		set_avx(dst, c, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 256 <= len; ofs += 256) {
+		_mm512_storeu_si512(dst + ofs, z);
+		_mm512_storeu_si512(dst + ofs + 64, z);
+		_mm512_storeu_si512(dst + ofs + 128, z);
+		_mm512_storeu_si512(dst + ofs + 192, z);
+	}
+	for (; ofs + 64 <= len; ofs += 64)
+		_mm512_storeu_si512(dst + ofs, z);
+	if (ofs < len)
+		_mm512_storeu_si512(dst + len - 64, z);
+}
+#endif
+
+#ifdef __aarch64__
+/* 64 bytes per ldp/stp pair of q registers */
+static void copy_ldp(void *dst, const void *src, size_t len)
+{
+	size_t ofs;
+
+	if (len < 64) {
+		copy_small(dst, src, len);
+		return;
+	}
+
+	for (ofs = 0; ofs + 64 <= len; ofs += 64)
+		asm volatile("ldp q0, q1, [%1]\n\t"
+			     "ldp q2, q3, [%1, #32]\n\t"
+			     "stp q0, q1, [%0]\n\t"
+			     "stp q2, q3, [%0, #32]\n\t"
+			     : : "r" (dst + ofs), "r" (src + ofs) : "v0", "v1", "v2", "v3", "memory");
+	if (ofs < len)
+		asm volatile("ldp q0, q1, [%1]\n\t"
+			     "ldp q2, q3, [%1, #32]\n\t"
+			     "stp q0, q1, [%0]\n\t"
+			     "stp q2, q3, [%0, #32]\n\t"
+			     : : "r" (dst + len - 64), "r" (src + len - 64) : "v0", "v1", "v2", "v3", "memory");
+}
+
+static void set_stp(void *dst, int c, size_t len)
+{
+	uint8x16_t v;
+	size_t ofs;
+
+	if (len < 64) {
+		set_small(dst, c, len);
+		return;
+	}
+
+	/* the vector is an operand, registers are not preserved between asm */
+	v = vdupq_n_u8(c);
+	for (ofs = 0; ofs + 64 <= len; ofs += 64)
+		asm volatile("stp %q1, %q1, [%0]\n\t"
+			     "stp %q1, %q1, [%0, #32]\n\t"
+			     : : "r" (dst + ofs), "w" (v) : "memory");
+	if (ofs < len)
+		asm volatile("stp %q1, %q1, [%0]\n\t"
+			     "stp %q1, %q1, [%0, #32]\n\t"
+			     : : "r" (dst + len - 64), "w" (v) : "memory");
+}
+#endif
+
+static const struct copy_impl copy_impls[] = {
+	{ "libc",   copy_libc,   set_libc   },
+#if HAS_REP_MOVSB
+	{ "movsb",  copy_movsb,  set_stosb  },
+#endif
+#ifdef __SSE2__
+	{ "sse",    copy_sse,    set_sse    },
+#endif
+#ifdef __AVX__
+	{ "avx",    copy_avx,    set_avx    },
+#endif
+#ifdef __AVX512F__
+	{ "avx512", copy_avx512, set_avx512 },
+#endif
+#ifdef __SSE2__
+	{ "nt",     copy_nt,     set_nt     },
+#endif
+#ifdef __aarch64__
+	{ "ldp",    copy_ldp,    set_stp    },
+#endif
+	{ NULL, NULL, NULL }
+};
+
+/*****************************************************************************
+ *                             scan implementations                          *
+ *****************************************************************************/
+
+/* The SIMD implementations are built on three primitives returning a 64-bit
+ * mask of the bytes matching in a 64-byte block: bytes equal to a value,
+ * bytes equal between two blocks, and bytes belonging to a byte set. The
+ * generic functions below walk the blocks using these primitives, which are
+ * inlined, and finish with scalar code.
+ */
+typedef uint64_t (*eqb_fct)(const char *p, int c);
+typedef uint64_t (*eqm_fct)(const char *a, const char *b);
+typedef uint64_t (*inset_fct)(const char *p, const struct byteset *bs);
+
+/* an implementation of the scan functions. findset() returns the first byte
+ * of the <n> bytes at <s> which belongs to <bs>, or NULL. Functions may be
+ * NULL when not supported.
+ */
+struct scan_impl {
+	const char *name;
+	const void *(*chr)(const void *s, int c, size_t n);
+	const void *(*rchr)(const void *s, int c, size_t n);
+	size_t (*len)(const char *s);
+	int (*cmp)(const void *a, const void *b, size_t n);
+	const void *(*findset)(const void *s, size_t n, const struct byteset *bs);
+};
+
+/* returns non-zero if byte <b> belongs to byte set <bs> */
+static inline int in_byteset(unsigned char b, const struct byteset *bs)
+{
+	return bs->map[b >> 3] & (1 << (b & 7));
+}
+
+/* Builds byte set <bs> from the NUL-terminated list of bytes <str>. Each high
+ * nibble gets its own bit, so sets spanning more than 8 different high
+ * nibbles are not supported. Returns zero in this case.
+ */
+static int build_byteset(struct byteset *bs, const char *str)
+{
+	unsigned char b;
+	int hibit[16];
+	int bits = 0, h;
+
+	memset(bs, 0, sizeof(*bs));
+	memset(hibit, -1, sizeof(hibit));
+	bs->str = str;
+
+	for (; *str; str++) {
+		b = *str;
+		h = b >> 4;
+		if (hibit[h] < 0) {
+			if (bits == 8)
+				return 0;
+			hibit[h] = bits++;
+			bs->hi[h] = 1 << hibit[h];
+		}
+		bs->lo[b & 15] |= 1 << hibit[h];
+		bs->map[b >> 3] |= 1 << (b & 7);
+	}
+	return 1;
+}
+
+static inline __attribute__((always_inline))
+const void *gen_memchr(const void *s, int c, size_t n, eqb_fct eqb)
+{
+	const char *p = s, *end = p + n;
+	uint64_t m;
+
+	for (; p + 64 <= end; p += 64) {
+		m = eqb(p, c);
+		if (m)
+			return p + __builtin_ctzll(m);
+	}
+	for (; p < end; p++)
+		if (*p == (char)c)
+			return p;
+	return NULL;
+}
+
+static inline __attribute__((always_inline))
+const void *gen_memrchr(const void *s, int c, size_t n, eqb_fct eqb)
+{
+	const char *start = s, *p = start + n;
+	uint64_t m;
+
+	for (; p - start >= 64; ) {
+		p -= 64;
+		m = eqb(p, c);
+		if (m)
+			return p + 63 - __builtin_clzll(m);
+	}
+	while (p > start)
+		if (*--p == (char)c)
+			return p;
+	return NULL;
+}
+
+/* Blocks are read aligned so that they never cross a page, thus the first one
+ * may start before <s>.
+ */
+static inline __attribute__((always_inline))
+size_t gen_strlen(const char *s, eqb_fct eqb)
+{
+	const char *p = (const char *)((uintptr_t)s & -(uintptr_t)64);
+	uint64_t m;
+
+	m = eqb(p, 0) >> (s - p);
+	if (m)
+		return __builtin_ctzll(m);
+
+	for (p += 64; ; p += 64) {
+		m = eqb(p, 0);
+		if (m)
+			return p + __builtin_ctzll(m) - s;
+	}
+}
+
+static inline __attribute__((always_inline))
+int gen_memcmp(const void *a, const void *b, size_t n, eqm_fct eqm)
+{
+	const unsigned char *x = a, *y = b;
+	size_t ofs;
+	uint64_t m;
+
+	for (ofs = 0; ofs + 64 <= n; ofs += 64) {
+		m = ~eqm((const char *)x + ofs, (const char *)y + ofs);
+		if (m) {
+			ofs += __builtin_ctzll(m);
+			return x[ofs] - y[ofs];
+		}
+	}
+	for (; ofs < n; ofs++)
+		if (x[ofs] != y[ofs])
+			return x[ofs] - y[ofs];
+	return 0;
+}
+
+static inline __attribute__((always_inline))
+const void *gen_findset(const void *s, size_t n, const struct byteset *bs, inset_fct inset)
+{
+	const char *p = s, *end = p + n;
+	uint64_t m;
+
+	for (; p + 64 <= end; p += 64) {
+		m = inset(p, bs);
+		if (m)
+			return p + __builtin_ctzll(m);
+	}
+	for (; p < end; p++)
+		if (in_byteset(*p, bs))
+			return p;
+	return NULL;
+}
+
+static const void *memchr_libc(const void *s, int c, size_t n)
+{
+	return memchr(s, c, n);
+}
+
+static const void *memrchr_libc(const void *s, int c, size_t n)
+{
+	return memrchr(s, c, n);
+}
+
+static size_t strlen_libc(const char *s)
+{
+	return strlen(s);
+}
+
+static int memcmp_libc(const void *a, const void *b, size_t n)
+{
+	return memcmp(a, b, n);
+}
+
+/* strcspn() stops on the NUL byte which must follow the <n> bytes */
+static const void *findset_libc(const void *s, size_t n, const struct byteset *bs)
+{
+	size_t len = strcspn(s, bs->str);
+
+	return len < n ? s + len : NULL;
+}
+
+/* scalar reference using the bitmap, used to check the other ones */
+static const void *findset_ref(const void *s, size_t n, const struct byteset *bs)
+{
+	const unsigned char *p = s;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		if (in_byteset(p[i], bs))
+			return p + i;
+	return NULL;
+}
+
+#ifdef __SSE2__
+static inline uint64_t mask_sse(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+	return (uint64_t)(uint16_t)_mm_movemask_epi8(m0) |
+	       (uint64_t)(uint16_t)_mm_movemask_epi8(m1) << 16 |
+	       (uint64_t)(uint16_t)_mm_movemask_epi8(m2) << 32 |
+	       (uint64_t)(uint16_t)_mm_movemask_epi8(m3) << 48;
+}
+
+static inline uint64_t eqb_sse(const char *p, int c)
+{
+	__m128i x = _mm_set1_epi8(c);
+
+	return mask_sse(_mm_cmpeq_epi8(_mm_loadu_si128((const void *)p), x),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(p + 16)), x),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(p + 32)), x),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(p + 48)), x));
+}
+
+static inline uint64_t eqm_sse(const char *a, const char *b)
+{
+	return mask_sse(_mm_cmpeq_epi8(_mm_loadu_si128((const void *)a), _mm_loadu_si128((const void *)b)),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(a + 16)), _mm_loadu_si128((const void *)(b + 16))),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(a + 32)), _mm_loadu_si128((const void *)(b + 32))),
+	                _mm_cmpeq_epi8(_mm_loadu_si128((const void *)(a + 48)), _mm_loadu_si128((const void *)(b + 48))));
+}
+
+static const void *memchr_sse(const void *s, int c, size_t n)
+{
+	return gen_memchr(s, c, n, eqb_sse);
+}
+
+static const void *memrchr_sse(const void *s, int c, size_t n)
+{
+	return gen_memrchr(s, c, n, eqb_sse);
+}
+
+static size_t strlen_sse(const char *s)
+{
+	return gen_strlen(s, eqb_sse);
+}
+
+static int memcmp_sse(const void *a, const void *b, size_t n)
+{
+	return gen_memcmp(a, b, n, eqm_sse);
+}
+
+#ifdef __SSSE3__
+/* pshufb looks up both nibbles of 16 bytes at once */
+static inline __m128i inset16_ssse3(__m128i v, __m128i lo, __m128i hi)
+{
+	__m128i nib = _mm_set1_epi8(15);
+
+	lo = _mm_shuffle_epi8(lo, _mm_and_si128(v, nib));
+	hi = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib));
+	return _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+}
+
+static inline uint64_t inset_ssse3(const char *p, const struct byteset *bs)
+{
+	__m128i lo = _mm_load_si128((const void *)bs->lo);
+	__m128i hi = _mm_load_si128((const void *)bs->hi);
+
+	return ~mask_sse(inset16_ssse3(_mm_loadu_si128((const void *)p), lo, hi),
+	                 inset16_ssse3(_mm_loadu_si128((const void *)(p + 16)), lo, hi),
+	                 inset16_ssse3(_mm_loadu_si128((const void *)(p + 32)), lo, hi),
+	                 inset16_ssse3(_mm_loadu_si128((const void *)(p + 48)), lo, hi));
+}
+
+static const void *findset_ssse3(const void *s, size_t n, const struct byteset *bs)
+{
+	return gen_findset(s, n, bs, inset_ssse3);
+}
+#endif
+#endif
+
+#ifdef __AVX2__
+static inline uint64_t mask_avx2(__m256i m0, __m256i m1)
+{
+	return (uint64_t)(uint32_t)_mm256_movemask_epi8(m0) |
+	       (uint64_t)(uint32_t)_mm256_movemask_epi8(m1) << 32;
+}
+
+static inline uint64_t eqb_avx2(const char *p, int c)
+{
+	__m256i y = _mm256_set1_epi8(c);
+
+	return mask_avx2(_mm256_cmpeq_epi8(_mm256_loadu_si256((const void *)p), y),
+	                 _mm256_cmpeq_epi8(_mm256_loadu_si256((const void *)(p + 32)), y));
+}
+
+static inline uint64_t eqm_avx2(const char *a, const char *b)
+{
+	return mask_avx2(_mm256_cmpeq_epi8(_mm256_loadu_si256((const void *)a), _mm256_loadu_si256((const void *)b)),
+	                 _mm256_cmpeq_epi8(_mm256_loadu_si256((const void *)(a + 32)), _mm256_loadu_si256((const void *)(b + 32))));
+}
+
+/* vpshufb works on each 128-bit lane, so the tables are duplicated */
+static inline __m256i inset32_avx2(__m256i v, __m256i lo, __m256i hi)
+{
+	__m256i nib = _mm256_set1_epi8(15);
+
+	lo = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib));
+	hi = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib));
+	return _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+}
+
+static inline uint64_t inset_avx2(const char *p, const struct byteset *bs)
+{
+	__m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128((const void *)bs->lo));
+	__m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128((const void *)bs->hi));
+
+	return ~mask_avx2(inset32_avx2(_mm256_loadu_si256((const void *)p), lo, hi),
+	                  inset32_avx2(_mm256_loadu_si256((const void *)(p + 32)), lo, hi));
+}
+
+static const void *memchr_avx2(const void *s, int c, size_t n)
+{
+	return gen_memchr(s, c, n, eqb_avx2);
+}
+
+static const void *memrchr_avx2(const void *s, int c, size_t n)
+{
+	return gen_memrchr(s, c, n, eqb_avx2);
+}
+
+static size_t strlen_avx2(const char *s)
+{
+	return gen_strlen(s, eqb_avx2);
+}
+
+static int memcmp_avx2(const void *a, const void *b, size_t n)
+{
+	return gen_memcmp(a, b, n, eqm_avx2);
+}
+
+static const void *findset_avx2(const void *s, size_t n, const struct byteset *bs)
+{
+	return gen_findset(s, n, bs, inset_avx2);
+}
+#endif
+
+#ifdef __AVX512BW__
+static inline uint64_t eqb_avx512(const char *p, int c)
+{
+	return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p), _mm512_set1_epi8(c));
+}
+
+static inline uint64_t eqm_avx512(const char *a, const char *b)
+{
+	return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+}
+
+static inline uint64_t inset_avx512(const char *p, const struct byteset *bs)
+{
+	__m512i lo = _mm512_broadcast_i32x4(_mm_load_si128((const void *)bs->lo));
+	__m512i hi = _mm512_broadcast_i32x4(_mm_load_si128((const void *)bs->hi));
+	__m512i nib = _mm512_set1_epi8(15);
+	__m512i v = _mm512_loadu_si512(p);
+
+	lo = _mm512_shuffle_epi8(lo, _mm512_and_si512(v, nib));
+	hi = _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi16(v, 4), nib));
+	return _mm512_test_epi8_mask(lo, hi);
+}
+
+static const void *memchr_avx512(const void *s, int c, size_t n)
+{
+	return gen_memchr(s, c, n, eqb_avx512);
+}
+
+static const void *memrchr_avx512(const void *s, int c, size_t n)
+{
+	return gen_memrchr(s, c, n, eqb_avx512);
+}
+
+static size_t strlen_avx512(const char *s)
+{
+	return gen_strlen(s, eqb_avx512);
+}
+
+static int memcmp_avx512(const void *a, const void *b, size_t n)
+{
+	return gen_memcmp(a, b, n, eqm_avx512);
+}
+
+static const void *findset_avx512(const void *s, size_t n, const struct byteset *bs)
+{
+	return gen_findset(s, n, bs, inset_avx512);
+}
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+/* turns 4 vectors of 0x00/0xff bytes into a 64-bit mask by keeping one bit
+ * per byte then adding pairs of neighbours until 8 bytes remain.
+ */
+static inline uint64_t mask_neon(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3)
+{
+	const uint8x16_t bits = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t s0, s1;
+
+	s0 = vpaddq_u8(vandq_u8(m0, bits), vandq_u8(m1, bits));
+	s1 = vpaddq_u8(vandq_u8(m2, bits), vandq_u8(m3, bits));
+	s0 = vpaddq_u8(s0, s1);
+	s0 = vpaddq_u8(s0, s0);
+	return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+static inline uint64_t eqb_neon(const char *p, int c)
+{
+	uint8x16_t x = vdupq_n_u8(c);
+	const uint8_t *u = (const uint8_t *)p;
+
+	return mask_neon(vceqq_u8(vld1q_u8(u), x), vceqq_u8(vld1q_u8(u + 16), x),
+	                 vceqq_u8(vld1q_u8(u + 32), x), vceqq_u8(vld1q_u8(u + 48), x));
+}
+
+static inline uint64_t eqm_neon(const char *a, const char *b)
+{
+	const uint8_t *u = (const uint8_t *)a, *v = (const uint8_t *)b;
+
+	return mask_neon(vceqq_u8(vld1q_u8(u), vld1q_u8(v)), vceqq_u8(vld1q_u8(u + 16), vld1q_u8(v + 16)),
+	                 vceqq_u8(vld1q_u8(u + 32), vld1q_u8(v + 32)), vceqq_u8(vld1q_u8(u + 48), vld1q_u8(v + 48)));
+}
+
+/* tbl looks up both nibbles of 16 bytes at once */
+static inline uint8x16_t inset16_neon(uint8x16_t v, uint8x16_t lo, uint8x16_t hi)
+{
+	lo = vqtbl1q_u8(lo, vandq_u8(v, vdupq_n_u8(15)));
+	hi = vqtbl1q_u8(hi, vshrq_n_u8(v, 4));
+	return vtstq_u8(lo, hi);
+}
+
+static inline uint64_t inset_neon(const char *p, const struct byteset *bs)
+{
+	uint8x16_t lo = vld1q_u8(bs->lo);
+	uint8x16_t hi = vld1q_u8(bs->hi);
+	const uint8_t *u = (const uint8_t *)p;
+
+	return mask_neon(inset16_neon(vld1q_u8(u), lo, hi), inset16_neon(vld1q_u8(u + 16), lo, hi),
+	                 inset16_neon(vld1q_u8(u + 32), lo, hi), inset16_neon(vld1q_u8(u + 48), lo, hi));
+}
+
+static const void *memchr_neon(const void *s, int c, size_t n)
+{
+	return gen_memchr(s, c, n, eqb_neon);
+}
+
+static const void *memrchr_neon(const void *s, int c, size_t n)
+{
+	return gen_memrchr(s, c, n, eqb_neon);
+}
+
+static size_t strlen_neon(const char *s)
+{
+	return gen_strlen(s, eqb_neon);
+}
+
+static int memcmp_neon(const void *a, const void *b, size_t n)
+{
+	return gen_memcmp(a, b, n, eqm_neon);
+}
+
+static const void *findset_neon(const void *s, size_t n, const struct byteset *bs)
+{
+	return gen_findset(s, n, bs, inset_neon);
+}
+#endif
+
+static const struct scan_impl scan_impls[] = {
+	{ "libc",   memchr_libc,   memrchr_libc,   strlen_libc,   memcmp_libc,   findset_libc   },
+#ifdef __SSE2__
+#ifdef __SSSE3__
+	{ "sse",    memchr_sse,    memrchr_sse,    strlen_sse,    memcmp_sse,    findset_ssse3  },
+#else
+	{ "sse",    memchr_sse,    memrchr_sse,    strlen_sse,    memcmp_sse,    NULL           },
+#endif
+#endif
+#ifdef __AVX2__
+	{ "avx2",   memchr_avx2,   memrchr_avx2,   strlen_avx2,   memcmp_avx2,   findset_avx2   },
+#endif
+#ifdef __AVX512BW__
+	{ "avx512", memchr_avx512, memrchr_avx512, strlen_avx512, memcmp_avx512, findset_avx512 },
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+	{ "neon",   memchr_neon,   memrchr_neon,   strlen_neon,   memcmp_neon,   findset_neon   },
+#endif
+	{ NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/*****************************************************************************
+ *                                 measurements                              *
+ *****************************************************************************/
+
+/* returns non-zero if the implementation called <name> was selected */
+static int impl_enabled(const char *name)
+{
+	const char *next = impl_list;
+	size_t len;
+
+	if (!next)
+		return 1;
+
+	while (*next) {
+		len = strcspn(next, ",");
+		if (strlen(name) == len && strncmp(name, next, len) == 0)
+			return 1;
+		next += len;
+		if (*next == ',')
+			next++;
+	}
+	return 0;
+}
+
+/* Allocates <size> bytes aligned to a page and touches them. Exits on failure. */
+static void *alloc_buffer(size_t size)
+{
+	void *area;
+
+	if (posix_memalign(&area, 4096, size) != 0 || !area) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+	memset(area, 0, size);
+	return area;
+}
+
+/* Returns the size in bytes of the largest cache reported by the system, or
+ * zero if unknown.
+ */
+static size_t llc_size()
+{
+	char path[64];
+	unsigned long long val, max = 0;
+	char unit;
+	FILE *f;
+	int idx;
+
+	for (idx = 0; idx < 10; idx++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+		unit = 0;
+		if (fscanf(f, "%llu%c", &val, &unit) >= 1) {
+			if (unit == 'K')
+				val <<= 10;
+			else if (unit == 'M')
+				val <<= 20;
+			if (val > max)
+				max = val;
+		}
+		fclose(f);
+	}
+	return max;
+}
+
+/* formats size <size> into <str> using a B, k or M unit */
+static void size_str(char *str, size_t len, size_t size)
+{
+	if (size >= 1048576 && !(size & 1048575))
+		snprintf(str, len, "%lluM", (unsigned long long)(size >> 20));
+	else if (size >= 1024 && !(size & 1023))
+		snprintf(str, len, "%lluk", (unsigned long long)(size >> 10));
+	else
+		snprintf(str, len, "%lluB", (unsigned long long)size);
+}
+
+/* Repeatedly copies <len> bytes from <src> to <dst> with implementation
+ * <impl>, or sets them if <src> is NULL, for about <usec> microseconds. Calls
+ * are batched to limit the cost of reading the time. Returns the number of
+ * bytes processed per nanosecond, that is GB/s.
+ */
+static double measure_copy(const struct copy_impl *impl, void *dst, const void *src, size_t len, unsigned int usec)
+{
+	unsigned long long before, now;
+	uint64_t calls = 0, batch = 1, i;
+
+	before = now = rdtsc();
+	do {
+		if (src) {
+			for (i = 0; i < batch; i++) {
+				impl->copy(dst, src, len);
+				asm("" ::: "memory");
+			}
+		} else {
+			for (i = 0; i < batch; i++) {
+				impl->set(dst, (int)i, len);
+				asm("" ::: "memory");
+			}
+		}
+		calls += batch;
+		now = rdtsc();
+		if (now - before < usec / 16)
+			batch *= 2;
+	} while (now - before < usec);
+
+	return (double)calls * len / (now - before) / 1000.0;
+}
+
+/* Measures the copy (or set if <set> is non-zero) speed of all implementations
+ * for sizes from MIN_SIZE to <size_max> bytes, each during <usec>
+ * microseconds. The last column indicates the fastest implementation for each
+ * size, which reveals the crossover points.
+ */
+static void copy_sweep(unsigned int usec, size_t size_max, int set, int quiet)
+{
+	const struct copy_impl *impl;
+	void *src = NULL, *dst;
+	double speed, best;
+	const char *best_name;
+	char str[24];
+	size_t size;
+
+	dst = alloc_buffer(size_max);
+	if (!set)
+		src = alloc_buffer(size_max);
+
+	if (!quiet) {
+		printf("%s GB/s\n   size:", set ? "memset" : "memcpy");
+		for (impl = copy_impls; impl->name; impl++)
+			if (impl_enabled(impl->name))
+				printf("%6s ", impl->name);
+		printf("%6s\n", "best");
+	}
+
+	for (size = MIN_SIZE; size <= size_max; size *= 2) {
+		size_str(str, sizeof(str), size);
+		printf(quiet ? "%6s " : "%6s: ", str);
+		best = 0;
+		best_name = "-";
+		for (impl = copy_impls; impl->name; impl++) {
+			if (!impl_enabled(impl->name))
+				continue;
+			speed = measure_copy(impl, dst, src, size, usec);
+			if (speed > best) {
+				best = speed;
+				best_name = impl->name;
+			}
+			printf("%6.2f ", speed);
+			fflush(stdout);
+		}
+		printf("%6s\n", best_name);
+	}
+
+	free(dst);
+	free(src);
+}
+
+/* Measures the copy speed of each implementation for each size of the
+ * zero-terminated list <sizes>, for all combinations of source and destination
+ * offsets from 0 to 63 bytes relative to a page, each during <usec>
+ * microseconds. One matrix of GB/s is emitted per implementation and size,
+ * with one row per source offset and one column per destination offset. Since
+ * both buffers are page-aligned, 4k aliasing appears when the destination is
+ * slightly above the source, and split lines on the non-zero offsets.
+ */
+static void align_matrix(unsigned int usec, const unsigned int *sizes, int quiet)
+{
+	const struct copy_impl *impl;
+	unsigned int sofs, dofs;
+	void *src, *dst;
+	int sz;
+
+	for (impl = copy_impls; impl->name; impl++) {
+		if (!impl_enabled(impl->name))
+			continue;
+		for (sz = 0; sizes[sz]; sz++) {
+			src = alloc_buffer(sizes[sz] + 64);
+			dst = alloc_buffer(sizes[sz] + 64);
+
+			if (!quiet) {
+				printf("%s %u bytes GB/s, src ofs in rows, dst ofs in columns\nsrc\\dst:", impl->name, sizes[sz]);
+				for (dofs = 0; dofs < 64; dofs++)
+					printf("%6u ", dofs);
+				printf("\n");
+			}
+
+			for (sofs = 0; sofs < 64; sofs++) {
+				printf(quiet ? "%6u " : "%6u: ", sofs);
+				for (dofs = 0; dofs < 64; dofs++)
+					printf("%6.2f ", measure_copy(impl, dst + dofs, src + sofs, sizes[sz], usec));
+				printf("\n");
+				fflush(stdout);
+			}
+			if (!quiet)
+				printf("\n");
+			free(src);
+			free(dst);
+		}
+	}
+}
+
+/* Parses the decimal number which must start at <p> into <val>, and returns
+ * the pointer to the first character after it, or NULL if there is no number
+ * or it doesn't fit in an unsigned int. Whitespace, including line feeds, is
+ * never skipped.
+ */
+static const char *parse_uint(const char *p, unsigned int *val)
+{
+	unsigned long ret;
+	char *end;
+
+	if (*p < '0' || *p > '9')
+		return NULL;
+	ret = strtoul(p, &end, 10);
+	if (ret > ~0U)
+		return NULL;
+	*val = ret;
+	return end;
+}
+
+/* Parses the size distribution in <text>, made of lines "<size>[-<max>]
+ * <weight>" where the size is uniformly picked between <size> and <max>, and
+ * '#' starts a comment. Stores up to MAX_DIST_ENTRIES entries into <dist> and
+ * returns their number, or zero on error.
+ */
+static int parse_dist(const char *text, struct dist_entry *dist)
+{
+	unsigned int min, max, weight;
+	const char *p, *eol;
+	int nbe = 0;
+
+	while (*text) {
+		eol = text + strcspn(text, "\n");
+		p = text + strspn(text, " \t\r");
+		if (p < eol && *p != '#') {
+			if (nbe >= MAX_DIST_ENTRIES)
+				return 0;
+			if (!(p = parse_uint(p, &min)))
+				return 0;
+			max = min;
+			if (*p == '-' && !(p = parse_uint(p + 1, &max)))
+				return 0;
+			if (*p != ' ' && *p != '\t')
+				return 0;
+			p += strspn(p, " \t");
+			if (!(p = parse_uint(p, &weight)))
+				return 0;
+			p += strspn(p, " \t\r");
+			if (p != eol && *p != '#')
+				return 0;
+			if (!min || max < min || !weight)
+				return 0;
+			dist[nbe].min = min;
+			dist[nbe].max = max;
+			dist[nbe].weight = weight;
+			nbe++;
+		}
+		text = eol;
+		if (*text)
+			text++;
+	}
+	return nbe;
+}
+
+/* Loads the size distribution from preset or file <name> into <dist>. Returns
+ * the number of entries. Exits on error.
+ */
+static int load_dist(const char *name, struct dist_entry *dist)
+{
+	static char text[65536];
+	size_t len;
+	FILE *f;
+	int idx, nbe;
+
+	for (idx = 0; dist_presets[idx].name; idx++)
+		if (strcmp(dist_presets[idx].name, name) == 0)
+			break;
+
+	if (dist_presets[idx].name)
+		nbe = parse_dist(dist_presets[idx].hist, dist);
+	else {
+		f = fopen(name, "r");
+		if (!f) {
+			fprintf(stderr, "Cannot open distribution file '%s'.\n", name);
+			exit(1);
+		}
+		len = fread(text, 1, sizeof(text) - 1, f);
+		text[len] = 0;
+		fclose(f);
+		if (len == sizeof(text) - 1) {
+			fprintf(stderr, "Distribution file '%s' too large (max %u bytes).\n",
+			        name, (unsigned int)sizeof(text) - 2);
+			exit(1);
+		}
+		nbe = parse_dist(text, dist);
+	}
+
+	if (!nbe) {
+		fprintf(stderr, "Invalid distribution '%s'.\n", name);
+		exit(1);
+	}
+	return nbe;
+}
+
+/* Replays DIST_OPS copies whose sizes follow the <nbe> entries of distribution
+ * <dist>, from random offsets of a <pool> bytes source to random offsets of a
+ * <pool> bytes destination, with each implementation during <usec>
+ * microseconds. Sizes and addresses are random so that branch predictors do
+ * not learn them. Reports the average time per copy in nanoseconds.
+ */
+static void dist_replay(unsigned int usec, size_t pool, const struct dist_entry *dist, int nbe, int quiet)
+{
+	const struct copy_impl *impl;
+	struct copy_op *ops;
+	uint64_t rnd = 0x9E3779B97F4A7C15ULL;
+	uint64_t total = 0, bytes = 0, calls, r;
+	unsigned long long before, now;
+	void *src, *dst;
+	int op, e;
+
+	for (e = 0; e < nbe; e++) {
+		total += dist[e].weight;
+		if (dist[e].max > pool) {
+			fprintf(stderr, "Fatal: pool too small for %u bytes copies.\n", dist[e].max);
+			exit(1);
+		}
+	}
+
+	ops = malloc(DIST_OPS * sizeof(*ops));
+	if (!ops) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+	for (op = 0; op < DIST_OPS; op++) {
+		/* xorshift64 */
+		rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+		for (r = rnd % total, e = 0; r >= dist[e].weight; e++)
+			r -= dist[e].weight;
+		rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+		ops[op].len = dist[e].min + rnd % (dist[e].max - dist[e].min + 1);
+		rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+		ops[op].src = (rnd >> 32) % (pool - ops[op].len + 1);
+		ops[op].dst = (uint32_t)rnd % (pool - ops[op].len + 1);
+		bytes += ops[op].len;
+	}
+
+	src = alloc_buffer(pool);
+	dst = alloc_buffer(pool);
+
+	if (!quiet)
+		printf("%u copies of %.1f bytes avg over %llu kB pools\n   impl: ns/copy   GB/s\n",
+		       DIST_OPS, (double)bytes / DIST_OPS, (unsigned long long)(pool >> 10));
+
+	for (impl = copy_impls; impl->name; impl++) {
+		if (!impl_enabled(impl->name))
+			continue;
+		calls = 0;
+		before = now = rdtsc();
+		do {
+			for (op = 0; op < DIST_OPS; op++)
+				impl->copy(dst + ops[op].dst, src + ops[op].src, ops[op].len);
+			asm("" ::: "memory");
+			calls += DIST_OPS;
+			now = rdtsc();
+		} while (now - before < usec);
+
+		printf(quiet ? "%6s " : "%6s: ", impl->name);
+		printf("%7.3f %6.2f\n", (now - before) * 1000.0 / calls,
+		       (double)bytes * (calls / DIST_OPS) / (now - before) / 1000.0);
+		fflush(stdout);
+	}
+
+	free(ops);
+	free(src);
+	free(dst);
+}
+
+/* Returns the frequency in GHz used to convert speeds to cycles per byte: the
+ * TSC rate calibrated over 20ms on x86, otherwise the max frequency reported
+ * by cpufreq. Returns zero if unknown.
+ */
+static double cpu_ghz()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned long long before, now;
+	unsigned int lo, hi;
+	uint64_t tsc0, tsc1;
+
+	before = rdtsc();
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	tsc0 = (uint64_t)hi << 32 | lo;
+	do {
+		now = rdtsc();
+	} while (now - before < 20000);
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	tsc1 = (uint64_t)hi << 32 | lo;
+	return (double)(tsc1 - tsc0) / (now - before) / 1000.0;
+#else
+	unsigned long long khz = 0;
+	FILE *f;
+
+	f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+	if (f) {
+		if (fscanf(f, "%llu", &khz) != 1)
+			khz = 0;
+		fclose(f);
+	}
+	return khz / 1000000.0;
+#endif
+}
+
+/* fills <len> bytes at <buf> with random lower case letters */
+static void fill_letters(char *buf, size_t len, uint64_t *rnd)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		*rnd ^= *rnd << 13; *rnd ^= *rnd >> 7; *rnd ^= *rnd << 17;
+		buf[i] = 'a' + (*rnd >> 32) % 26;
+	}
+}
+
+/* Runs function <func> of implementation <impl> over the <size> bytes of <buf>
+ * as a parser would, restarting after each match, or over consecutive records
+ * of <dens> bytes (all of them if zero) of <buf> and <buf2> for memcmp().
+ * Returns the number of matches or equal records.
+ */
+static size_t scan_pass(const struct scan_impl *impl, int func, const char *buf, const char *buf2,
+                        size_t size, size_t dens, const struct byteset *bs)
+{
+	const char *p = buf, *end = buf + size, *q;
+	size_t n = 0, ofs, rec;
+
+	switch (func) {
+	case SCAN_CHR:
+		while ((q = impl->chr(p, SCAN_CHAR, end - p))) {
+			n++;
+			p = q + 1;
+		}
+		break;
+	case SCAN_RCHR:
+		while ((q = impl->rchr(buf, SCAN_CHAR, end - buf))) {
+			n++;
+			end = q;
+		}
+		break;
+	case SCAN_LEN:
+		/* a NUL follows the buffer */
+		for (; p < end; n++)
+			p += impl->len(p) + 1;
+		break;
+	case SCAN_CMP:
+		rec = dens ? dens : size;
+		for (ofs = 0; ofs < size; ofs += rec)
+			n += impl->cmp(buf + ofs, buf2 + ofs, rec < size - ofs ? rec : size - ofs) == 0;
+		break;
+	case SCAN_SET_FIND:
+		while ((q = impl->findset(p, end - p, bs))) {
+			n++;
+			p = q + 1;
+		}
+		break;
+	}
+	return n;
+}
+
+/* Checks all scan implementations against libc (or the bitmap for the byte
+ * set search) for all offsets from 0 to 63 and lengths from 0 to 300 bytes
+ * plus a few larger ones, with and without a match placed at random. Reports
+ * failures and returns their number.
+ */
+static int scan_check(const struct byteset *bs)
+{
+	static const size_t lens[] = { 1000, 1023, 1024, 1025, 4000 };
+	const struct scan_impl *impl;
+	uint64_t rnd = 0x9E3779B97F4A7C15ULL;
+	size_t len, pos, nbl;
+	char *buf, *buf2, *p;
+	unsigned int ofs;
+	int errors = 0;
+	int r, ref;
+
+	buf = alloc_buffer(8192);
+	buf2 = alloc_buffer(8192);
+
+	for (ofs = 0; ofs < 64; ofs++) {
+		for (nbl = 0; nbl < 301 + sizeof(lens) / sizeof(*lens); nbl++) {
+			len = nbl < 301 ? nbl : lens[nbl - 301];
+			p = buf + ofs;
+
+			/* no match unless <pos> is within the buffer */
+			fill_letters(buf, 8192, &rnd);
+			pos = (rnd >> 16) % (len + len / 4 + 1);
+			if (pos < len) {
+				p[pos] = SCAN_CHAR;
+				if (rnd & 1) /* and sometimes a second one */
+					p[(rnd >> 40) % len] = SCAN_CHAR;
+			}
+			p[len] = 0;
+			memcpy(buf2, buf, 8192);
+			if (pos < len)
+				buf2[ofs + pos] ^= 1 << (rnd >> 8) % 8;
+
+			for (impl = scan_impls; impl->name; impl++) {
+				if (impl->chr(p, SCAN_CHAR, len) != memchr(p, SCAN_CHAR, len)) {
+					printf("%s: memchr() failed at offset %u length %zu\n", impl->name, ofs, len);
+					errors++;
+				}
+				if (impl->rchr(p, SCAN_CHAR, len) != memrchr(p, SCAN_CHAR, len)) {
+					printf("%s: memrchr() failed at offset %u length %zu\n", impl->name, ofs, len);
+					errors++;
+				}
+				if (impl->len(p) != len) {
+					printf("%s: strlen() failed at offset %u length %zu\n", impl->name, ofs, len);
+					errors++;
+				}
+				r = impl->cmp(p, buf2 + ofs, len);
+				ref = memcmp(p, buf2 + ofs, len);
+				if ((r < 0) != (ref < 0) || (r > 0) != (ref > 0)) {
+					printf("%s: memcmp() failed at offset %u length %zu\n", impl->name, ofs, len);
+					errors++;
+				}
+				if (impl->findset && impl->findset(p, len, bs) != findset_ref(p, len, bs)) {
+					printf("%s: byte set search failed at offset %u length %zu\n", impl->name, ofs, len);
+					errors++;
+				}
+			}
+		}
+	}
+
+	free(buf);
+	free(buf2);
+	return errors;
+}
+
+/* Measures the scan functions of all implementations over buffers from 4kB to
+ * <size_max> bytes in steps of 4, with no match then one match every 4096,
+ * 256, 64 and 16 bytes, each during <usec> microseconds. memcmp() compares
+ * equal records of that many bytes instead. Results are in GB/s followed by
+ * cycles per byte when the CPU frequency is known. All implementations are
+ * checked against libc first.
+ */
+static void scan_suite(unsigned int usec, size_t size_max, int quiet)
+{
+	static const size_t denss[] = { 0, 4096, 256, 64, 16 };
+	const struct scan_impl *impl;
+	uint64_t rnd = 0x9E3779B97F4A7C15ULL;
+	unsigned long long before, now;
+	uint64_t passes, batch, i;
+	struct byteset bs;
+	char *buf, *buf2;
+	char str[24];
+	size_t size, dens, ofs;
+	size_t sink = 0;
+	double speed, ghz;
+	int func, d;
+
+	if (!build_byteset(&bs, SCAN_SET)) {
+		fprintf(stderr, "Fatal: byte set spans too many high nibbles.\n");
+		exit(1);
+	}
+
+	if (scan_check(&bs) != 0) {
+		fprintf(stderr, "Fatal: some implementations are broken.\n");
+		exit(1);
+	}
+
+	ghz = cpu_ghz();
+	if (!quiet) {
+		if (ghz > 0)
+			printf("All implementations checked; cycles/byte at %.2f GHz\n", ghz);
+		else
+			printf("All implementations checked; unknown CPU frequency\n");
+	}
+
+	/* a NUL always follows the buffer for strlen() and strcspn() */
+	buf = alloc_buffer(size_max + 64);
+	buf2 = alloc_buffer(size_max + 64);
+
+	for (func = 0; func < SCAN_FUNCS; func++) {
+		if (!quiet) {
+			printf("\n%s GB/s c/B\n   size  dens:", scan_names[func]);
+			for (impl = scan_impls; impl->name; impl++)
+				if (impl_enabled(impl->name))
+					printf("%12s ", impl->name);
+			printf("\n");
+		}
+
+		for (size = 4096; size <= size_max; size *= 4) {
+			for (d = 0; d < sizeof(denss) / sizeof(*denss); d++) {
+				dens = denss[d];
+				if (dens >= size)
+					continue;
+
+				fill_letters(buf, size, &rnd);
+				if (func == SCAN_CMP)
+					memcpy(buf2, buf, size);
+				else if (dens) {
+					for (ofs = dens - 1; ofs < size; ofs += dens)
+						buf[ofs] = func == SCAN_LEN ? 0 :
+							func == SCAN_SET_FIND ? SCAN_SET[ofs / dens % strlen(SCAN_SET)] :
+							SCAN_CHAR;
+				}
+				buf[size] = 0;
+
+				size_str(str, sizeof(str), size);
+				printf("%6s ", str);
+				if (dens)
+					size_str(str, sizeof(str), dens);
+				else
+					strcpy(str, "-");
+				printf(quiet ? "%5s " : "%5s: ", str);
+
+				for (impl = scan_impls; impl->name; impl++) {
+					if (!impl_enabled(impl->name))
+						continue;
+					if (func == SCAN_SET_FIND && !impl->findset) {
+						printf("%12s ", "-");
+						continue;
+					}
+
+					passes = 0; batch = 1;
+					before = now = rdtsc();
+					do {
+						for (i = 0; i < batch; i++) {
+							sink += scan_pass(impl, func, buf, buf2, size, dens, &bs);
+							asm("" ::: "memory");
+						}
+						passes += batch;
+						now = rdtsc();
+						if (now - before < usec / 16)
+							batch *= 2;
+					} while (now - before < usec);
+
+					speed = (double)passes * size / (now - before) / 1000.0;
+					if (ghz > 0)
+						printf("%6.2f %5.3f ", speed, ghz / speed);
+					else
+						printf("%6.2f %5s ", speed, "-");
+					fflush(stdout);
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	/* prevents the passes from being optimized away */
+	if (sink == 1)
+		printf("\n");
+
+	free(buf);
+	free(buf2);
+}
+
+/* per-thread context of the multi-threaded mode */
+struct thread_ctx {
+	const struct copy_impl *copy;
+	const struct scan_impl *scan;
+	const struct byteset *bs;
+	const struct reclaim_strat *strat;
+	char *src, *dst;
+	size_t size;
+	uint64_t bytes;              // bytes processed
+	unsigned long long usec;     // time spent processing them
+	pthread_t pth;
+	int kern;
+	int cpu;                     // CPU to bind to, -1 for none
+} __attribute__((aligned(64)));
+
+static struct thread_ctx thread_ctx[MAX_THREADS];
+static int ready_threads;
+static volatile int start_now;
+static volatile int stop_now;
+
+/* return the default thread count based on the detected affinity settings. */
+static int default_thread_count()
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+		return CPU_COUNT(&mask);
+#endif
+	return 1;
+}
+
+/* Returns the <n>th CPU modulo the number of CPUs the process may run on, or
+ * -1 if unknown.
+ */
+static int nth_cpu(int n)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) != 0 || !CPU_COUNT(&mask))
+		return -1;
+
+	n %= CPU_COUNT(&mask);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &mask) && n-- == 0)
+			return cpu;
+#endif
+	return -1;
+}
+
+/* binds the calling thread to CPU <cpu> unless negative */
+static void bind_to_cpu(int cpu)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+
+/* Binds the thread to its CPU then allocates and fills its buffers so that
+ * the first touch places them on its NUMA node. Reports the thread as ready,
+ * waits for all other ones, then runs the kernel until stop_now is set.
+ */
+static void *run_thread(void *private)
+{
+	struct thread_ctx *ctx = private;
+	uint64_t rnd = 0x9E3779B97F4A7C15ULL + ctx->cpu;
+	unsigned long long before, now;
+	uint64_t bytes = 0;
+	size_t sink = 0;
+	int i = 0;
+
+	bind_to_cpu(ctx->cpu);
+
+	/* scans need letters followed by a NUL for strlen() and strcspn() */
+	ctx->dst = alloc_buffer(ctx->size + 64);
+	if (ctx->kern != KERN_SET)
+		ctx->src = alloc_buffer(ctx->size + 64);
+	if (ctx->kern < SCAN_FUNCS) {
+		fill_letters(ctx->src, ctx->size, &rnd);
+		memcpy(ctx->dst, ctx->src, ctx->size);
+	}
+
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+	while (!start_now)
+		;
+
+	before = rdtsc();
+	while (!stop_now) {
+		if (ctx->kern == KERN_COPY)
+			ctx->copy->copy(ctx->dst, ctx->src, ctx->size);
+		else if (ctx->kern == KERN_SET)
+			ctx->copy->set(ctx->dst, i++, ctx->size);
+		else
+			sink += scan_pass(ctx->scan, ctx->kern, ctx->src, ctx->dst, ctx->size, 0, ctx->bs);
+		asm("" ::: "memory");
+		bytes += ctx->size;
+	}
+	now = rdtsc();
+
+	ctx->bytes = bytes + (sink == 1);
+	ctx->usec = now - before;
+
+	free(ctx->src);
+	free(ctx->dst);
+	ctx->src = ctx->dst = NULL;
+	return NULL;
+}
+
+/* Starts <threads> threads running <fct> on their thread_ctx, bound to
+ * distinct CPUs. They are released together once all of them are ready, then
+ * stopped after <usec> microseconds. Returns once all of them are done.
+ */
+static void run_threads(int threads, unsigned int usec, void *(*fct)(void *))
+{
+	int thr;
+
+	ready_threads = 0;
+	start_now = stop_now = 0;
+
+	for (thr = 0; thr < threads; thr++) {
+		thread_ctx[thr].cpu = nth_cpu(thr);
+		if (pthread_create(&thread_ctx[thr].pth, NULL, fct, &thread_ctx[thr]) != 0) {
+			fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
+			exit(1);
+		}
+	}
+
+	/* start barrier: release all threads once their buffers are ready */
+	while (__atomic_load_n(&ready_threads, __ATOMIC_ACQUIRE) != threads)
+		usleep(1000);
+
+	start_now = 1;
+	usleep(usec);
+	stop_now = 1;
+
+	for (thr = 0; thr < threads; thr++)
+		pthread_join(thread_ctx[thr].pth, NULL);
+}
+
+/* Runs kernel <kern> (KERN_COPY, KERN_SET or a scan function) of each selected
+ * implementation on <threads> threads bound to distinct CPUs during <usec>
+ * microseconds, each thread working on its own buffers of <size> bytes. The
+ * threads are released at once after all buffers are ready. One row is
+ * emitted per implementation with the GB/s of each thread then the aggregate.
+ * Scans run over buffers without any match.
+ */
+static void thread_scaling(unsigned int usec, size_t size, int threads, int kern, int quiet)
+{
+	static double results[MAX_THREADS];
+	const struct copy_impl *impl = NULL;
+	const struct scan_impl *simpl = NULL;
+	struct byteset bs;
+	double total;
+	const char *name;
+	char str[24];
+	int thr;
+
+	build_byteset(&bs, SCAN_SET);
+
+	size_str(str, sizeof(str), size);
+	if (!quiet)
+		printf("%s of %s per thread on %d threads, GB/s\n   impl:",
+		       kern == KERN_COPY ? "memcpy" : kern == KERN_SET ? "memset" : scan_names[kern],
+		       str, threads);
+
+	if (!quiet) {
+		for (thr = 0; thr < threads; thr++)
+			printf("%6d ", thr);
+		printf("%6s\n", "total");
+	}
+
+	/* one row per implementation */
+	if (kern >= SCAN_FUNCS)
+		impl = copy_impls;
+	else
+		simpl = scan_impls;
+
+	while ((name = impl ? impl->name : simpl->name)) {
+		if (!impl_enabled(name) || (simpl && kern == SCAN_SET_FIND && !simpl->findset))
+			goto next;
+
+		for (thr = 0; thr < threads; thr++) {
+			thread_ctx[thr].copy = impl;
+			thread_ctx[thr].scan = simpl;
+			thread_ctx[thr].bs = &bs;
+			thread_ctx[thr].size = size;
+			thread_ctx[thr].kern = kern;
+		}
+		run_threads(threads, usec, run_thread);
+
+		total = 0;
+		for (thr = 0; thr < threads; thr++) {
+			results[thr] = thread_ctx[thr].usec ?
+				(double)thread_ctx[thr].bytes / thread_ctx[thr].usec / 1000.0 : 0;
+			total += results[thr];
+		}
+
+		printf(quiet ? "%6s " : "%6s: ", name);
+		for (thr = 0; thr < threads; thr++)
+			printf("%6.2f ", results[thr]);
+		printf("%6.2f\n", total);
+		fflush(stdout);
+	next:
+		if (impl)
+			impl++;
+		else
+			simpl++;
+	}
+}
+
+/* returns the user+system CPU time of the process in microseconds */
+static unsigned long long cpu_time()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+	       ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static void zc_start(struct zc_ctx *ctx)
+{
+	ctx->cpu0 = cpu_time();
+	ctx->wall0 = rdtsc();
+}
+
+static void zc_stop(struct zc_ctx *ctx)
+{
+	ctx->wall = rdtsc() - ctx->wall0;
+	ctx->cpu = cpu_time() - ctx->cpu0;
+}
+
+/* reads one byte per page of the <size> bytes at <area> as a consumer would.
+ * This faults on newly mapped areas such as memfd views, while remapped ones
+ * take no fault since mremap() moves the PTEs, but either way it loads the
+ * TLB entries that the next munmap() or mremap() will have to shoot down.
+ */
+static void touch_pages(const char *area, size_t size)
+{
+	size_t ofs;
+
+	for (ofs = 0; ofs < size; ofs += 4096)
+		asm volatile("" : : "r" (*(volatile const char *)(area + ofs)));
+}
+
+/* consumer side of the mapping based mechanisms, running on its own CPU: for
+ * each handoff it reads the pages handed over (<xfer>, or a fresh view of
+ * <memfd>) then acknowledges. The TLB invalidations caused by the munmap() or
+ * mremap() calls are thus remote ones, as they would be between processes.
+ */
+static void *zc_consumer(void *private)
+{
+	struct zc_ctx *ctx = private;
+	unsigned int seq = 0;
+	char *area;
+
+	bind_to_cpu(ctx->cons_cpu);
+	while (1) {
+		while (__atomic_load_n(&ctx->sent, __ATOMIC_ACQUIRE) == seq)
+			sched_yield();
+		seq++;
+		if (ctx->stop)
+			break;
+
+		if (ctx->memfd >= 0) {
+			area = mmap(NULL, ctx->size, PROT_READ, MAP_SHARED, ctx->memfd, 0);
+			if (area == MAP_FAILED)
+				ctx->failed = 1;
+			else {
+				touch_pages(area, ctx->size);
+				munmap(area, ctx->size);
+			}
+		}
+		else
+			touch_pages(ctx->xfer, ctx->size);
+		__atomic_store_n(&ctx->done, seq, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/* starts the consumer thread, returns 0 on failure */
+static int zc_consumer_start(struct zc_ctx *ctx, pthread_t *pth)
+{
+	ctx->sent = ctx->done = 0;
+	ctx->stop = ctx->failed = 0;
+	return pthread_create(pth, NULL, zc_consumer, ctx) == 0;
+}
+
+/* hands the transfer over to the consumer and waits for its acknowledgement.
+ * Returns 0 if the consumer failed.
+ */
+static int zc_handoff(struct zc_ctx *ctx)
+{
+	unsigned int seq = __atomic_add_fetch(&ctx->sent, 1, __ATOMIC_RELEASE);
+
+	while (__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE) != seq)
+		sched_yield();
+	return !ctx->failed;
+}
+
+static void zc_consumer_stop(struct zc_ctx *ctx, pthread_t *pth)
+{
+	ctx->stop = 1;
+	__atomic_add_fetch(&ctx->sent, 1, __ATOMIC_RELEASE);
+	pthread_join(*pth, NULL);
+}
+
+/* plain copy, the reference */
+static uint64_t zc_memcpy(struct zc_ctx *ctx, unsigned int usec)
+{
+	uint64_t bytes = 0;
+
+	zc_start(ctx);
+	do {
+		memcpy(ctx->dst, ctx->src, ctx->size);
+		touch_pages(ctx->dst, ctx->size);
+		bytes += ctx->size;
+	} while (rdtsc() - ctx->wall0 < usec);
+	zc_stop(ctx);
+	return bytes;
+}
+
+#ifdef __linux__
+/* moves the page table entries back and forth between the two areas */
+static uint64_t zc_mremap(struct zc_ctx *ctx, unsigned int usec)
+{
+	char *from = ctx->src, *to = ctx->dst, *tmp;
+	uint64_t bytes = 0;
+	pthread_t pth;
+
+	if (!zc_consumer_start(ctx, &pth))
+		return 0;
+
+	zc_start(ctx);
+	do {
+		if (mremap(from, ctx->size, ctx->size, MREMAP_MAYMOVE | MREMAP_FIXED, to) == MAP_FAILED)
+			break;
+		ctx->xfer = to;
+		zc_handoff(ctx);
+		tmp = from; from = to; to = tmp;
+		bytes += ctx->size;
+	} while (rdtsc() - ctx->wall0 < usec);
+	zc_stop(ctx);
+	zc_consumer_stop(ctx, &pth);
+
+	/* the source must remain where it was for the next mechanisms, and the
+	 * destination, left unmapped by the last move, must be mapped again.
+	 */
+	if ((from != ctx->src &&
+	     mremap(from, ctx->size, ctx->size, MREMAP_MAYMOVE | MREMAP_FIXED, ctx->src) == MAP_FAILED) ||
+	    mmap(ctx->dst, ctx->size, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+		printf("Failed to remap memory\n");
+		exit(1);
+	}
+	memset(ctx->dst, 0, ctx->size);
+	return bytes;
+}
+
+/* pipe reader for zc_vmsplice(): receives everything into dst until EOF */
+static void *zc_reader(void *private)
+{
+	struct zc_ctx *ctx = private;
+	size_t pos = 0;
+	ssize_t ret;
+
+	bind_to_cpu(ctx->cons_cpu);
+	while ((ret = read(ctx->pipefd[0], ctx->dst + pos, ctx->size - pos)) > 0) {
+		pos += ret;
+		if (pos == ctx->size)
+			pos = 0;
+	}
+	return NULL;
+}
+
+/* the source pages are referenced by the pipe with vmsplice(), then copied
+ * once by another thread reading the pipe.
+ */
+static uint64_t zc_vmsplice(struct zc_ctx *ctx, unsigned int usec)
+{
+	pthread_t pth;
+	struct iovec iov;
+	uint64_t bytes = 0;
+	size_t ofs;
+	ssize_t ret;
+
+	if (pipe(ctx->pipefd) < 0)
+		return 0;
+
+	/* may fail on limits, then the default size is used */
+	fcntl(ctx->pipefd[1], F_SETPIPE_SZ, ZC_PIPE_SIZE);
+
+	if (pthread_create(&pth, NULL, zc_reader, ctx) != 0) {
+		close(ctx->pipefd[0]);
+		close(ctx->pipefd[1]);
+		return 0;
+	}
+
+	zc_start(ctx);
+	do {
+		for (ofs = 0; ofs < ctx->size; ofs += ret) {
+			iov.iov_base = ctx->src + ofs;
+			iov.iov_len  = ctx->size - ofs;
+			ret = vmsplice(ctx->pipefd[1], &iov, 1, 0);
+			if (ret <= 0)
+				break;
+		}
+		if (ofs < ctx->size)
+			break;
+		bytes += ctx->size;
+	} while (rdtsc() - ctx->wall0 < usec);
+
+	/* the transfer ends when the reader got everything */
+	close(ctx->pipefd[1]);
+	pthread_join(pth, NULL);
+	zc_stop(ctx);
+	close(ctx->pipefd[0]);
+	return bytes;
+}
+
+/* another process reads the source from a forked child which shares it */
+static uint64_t zc_process_vm(struct zc_ctx *ctx, unsigned int usec)
+{
+	struct iovec local, remote;
+	uint64_t bytes = 0;
+	ssize_t ret;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		return 0;
+
+	if (pid == 0) {
+		pause();
+		_exit(0);
+	}
+
+	zc_start(ctx);
+	do {
+		local.iov_base  = ctx->dst;
+		local.iov_len   = ctx->size;
+		remote.iov_base = ctx->src;
+		remote.iov_len  = ctx->size;
+		ret = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+		if (ret != ctx->size) {
+			bytes = 0;
+			break;
+		}
+		touch_pages(ctx->dst, ctx->size);
+		bytes += ctx->size;
+	} while (rdtsc() - ctx->wall0 < usec);
+	zc_stop(ctx);
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return bytes;
+}
+
+/* the payload is produced in a shared memfd which the consumer maps, reads
+ * and unmaps for each transfer, paying the faults and TLB shootdowns.
+ */
+static uint64_t zc_memfd(struct zc_ctx *ctx, unsigned int usec)
+{
+	uint64_t bytes = 0;
+	pthread_t pth;
+	char *prod;
+	int fd;
+
+	fd = memfd_create("ramspeed", 0);
+	if (fd < 0)
+		return 0;
+
+	if (ftruncate(fd, ctx->size) < 0 ||
+	    (prod = mmap(NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	memcpy(prod, ctx->src, ctx->size);
+
+	ctx->memfd = fd;
+	if (!zc_consumer_start(ctx, &pth))
+		goto out;
+
+	zc_start(ctx);
+	do {
+		if (!zc_handoff(ctx)) {
+			bytes = 0;
+			break;
+		}
+		bytes += ctx->size;
+	} while (rdtsc() - ctx->wall0 < usec);
+	zc_stop(ctx);
+	zc_consumer_stop(ctx, &pth);
+out:
+	ctx->memfd = -1;
+	munmap(prod, ctx->size);
+	close(fd);
+	return bytes;
+}
+#endif
+
+static const struct zc_mech zc_mechs[] = {
+	{ "memcpy",  zc_memcpy     },
+#ifdef __linux__
+	{ "mremap",  zc_mremap     },
+	{ "vmsplice", zc_vmsplice  },
+	{ "pvreadv", zc_process_vm },
+	{ "memfd",   zc_memfd      },
+#endif
+	{ NULL, NULL }
+};
+
+/* Moves buffers from 4kB to <size_max> bytes in steps of 4 with each large
+ * transfer mechanism during <usec> microseconds, and reports the throughput
+ * in GB/s and the CPU time of all involved threads in picoseconds per byte,
+ * which includes the page faults and TLB shootdowns caused by remapping. The
+ * last column indicates the fastest mechanism for each size, which reveals
+ * the size above which moving pages beats copying.
+ */
+static void zero_copy(unsigned int usec, size_t size_max, int quiet)
+{
+	const struct zc_mech *mech;
+	struct zc_ctx ctx;
+	const char *best_name;
+	double speed, best;
+	uint64_t bytes;
+	char str[24];
+	int cpu;
+
+	/* the producer (this thread) and the consumers run on different CPUs
+	 * when possible, so that the TLB shootdowns are remote ones.
+	 */
+	cpu = nth_cpu(0);
+	ctx.cons_cpu = nth_cpu(1);
+	bind_to_cpu(cpu);
+	ctx.memfd = -1;
+
+	/* anonymous mappings so that they may be remapped */
+	size_max = (size_max + 4095) & -(size_t)4096;
+	ctx.src = mmap(NULL, size_max, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ctx.dst = mmap(NULL, size_max, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ctx.src == MAP_FAILED || ctx.dst == MAP_FAILED) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+	memset(ctx.src, 0x55, size_max);
+	memset(ctx.dst, 0, size_max);
+
+	if (!quiet) {
+		printf("transfer GB/s, CPU ps/B\n   size:");
+		for (mech = zc_mechs; mech->name; mech++)
+			printf("%12s ", mech->name);
+		printf("%8s\n", "best");
+	}
+
+	for (ctx.size = 4096; ctx.size <= size_max; ctx.size *= 4) {
+		size_str(str, sizeof(str), ctx.size);
+		printf(quiet ? "%6s " : "%6s: ", str);
+		best = 0;
+		best_name = "-";
+		for (mech = zc_mechs; mech->name; mech++) {
+			bytes = mech->run(&ctx, usec);
+			if (!bytes || !ctx.wall) {
+				printf("%12s ", "-");
+				continue;
+			}
+			speed = (double)bytes / ctx.wall / 1000.0;
+			if (speed > best) {
+				best = speed;
+				best_name = mech->name;
+			}
+			printf("%6.2f %5.0f ", speed, ctx.cpu * 1000000.0 / bytes);
+			fflush(stdout);
+		}
+		printf("%8s\n", best_name);
+	}
+
+	munmap(ctx.src, size_max);
+	munmap(ctx.dst, size_max);
+}
+
+static char *reclaim_memset(char *area, size_t size)
+{
+	memset(area, 0, size);
+	return area;
+}
+
+#if HAS_REP_MOVSB
+static char *reclaim_stosb(char *area, size_t size)
+{
+	set_stosb(area, 0, size);
+	return area;
+}
+#endif
+
+#ifdef __SSE2__
+static char *reclaim_nt(char *area, size_t size)
+{
+	set_nt(area, 0, size);
+	return area;
+}
+#endif
+
+static char *reclaim_dontneed(char *area, size_t size)
+{
+	return madvise(area, size, MADV_DONTNEED) == 0 ? area : NULL;
+}
+
+#ifdef MADV_FREE
+/* pages are only reclaimed under memory pressure, otherwise they are reused
+ * as they are without being zeroed.
+ */
+static char *reclaim_free(char *area, size_t size)
+{
+	return madvise(area, size, MADV_FREE) == 0 ? area : NULL;
+}
+#endif
+
+static char *reclaim_munmap(char *area, size_t size)
+{
+	munmap(area, size);
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return area == MAP_FAILED ? NULL : area;
+}
+
+static const struct reclaim_strat reclaim_strats[] = {
+	{ "memset",   reclaim_memset   },
+#if HAS_REP_MOVSB
+	{ "stosb",    reclaim_stosb    },
+#endif
+#ifdef __SSE2__
+	{ "nt",       reclaim_nt       },
+#endif
+	{ "dontneed", reclaim_dontneed },
+#ifdef MADV_FREE
+	{ "free",     reclaim_free     },
+#endif
+	{ "munmap",   reclaim_munmap   },
+	{ NULL, NULL }
+};
+
+/* Binds the thread to its CPU, maps and dirties its area, then once all
+ * threads are ready, resets the area with the strategy and writes one byte
+ * per page as the next user would, until stop_now is set. The number of pages
+ * reused is stored into <bytes>, or zero on failure.
+ */
+static void *run_reclaim(void *private)
+{
+	struct thread_ctx *ctx = private;
+	unsigned long long before;
+	uint64_t cycles = 0;
+	char *area;
+	size_t ofs;
+
+	bind_to_cpu(ctx->cpu);
+
+	area = mmap(NULL, ctx->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+	memset(area, 1, ctx->size);
+
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+	while (!start_now)
+		;
+
+	before = rdtsc();
+	do {
+		area = ctx->strat->reset(area, ctx->size);
+		if (!area) {
+			cycles = 0;
+			break;
+		}
+		for (ofs = 0; ofs < ctx->size; ofs += 4096)
+			*(volatile char *)(area + ofs) = 1;
+		cycles++;
+	} while (!stop_now);
+	ctx->usec = rdtsc() - before;
+	ctx->bytes = cycles * (ctx->size / 4096);
+
+	if (area)
+		munmap(area, ctx->size);
+	return NULL;
+}
+
+/* Measures the cost of making memory reusable with each strategy for sizes
+ * from 4kB to <size_max> bytes in steps of 4, on <threads> threads each
+ * recycling its own area during <usec> microseconds. The cost is reported in
+ * ns per page averaged over the threads, and includes the first write to each
+ * page by the next user, hence the faults after the area was released.
+ */
+static void reclaim_sweep(unsigned int usec, size_t size_max, int threads, int quiet)
+{
+	const struct reclaim_strat *strat;
+	char str[24];
+	double total;
+	size_t size;
+	int thr;
+
+	if (!quiet) {
+		printf("reuse cost on %d threads, ns/page\n   size:", threads);
+		for (strat = reclaim_strats; strat->name; strat++)
+			if (impl_enabled(strat->name))
+				printf("%8s ", strat->name);
+		printf("\n");
+	}
+
+	for (size = 4096; size <= size_max; size *= 4) {
+		size_str(str, sizeof(str), size);
+		printf(quiet ? "%6s " : "%6s: ", str);
+		for (strat = reclaim_strats; strat->name; strat++) {
+			if (!impl_enabled(strat->name))
+				continue;
+
+			for (thr = 0; thr < threads; thr++) {
+				thread_ctx[thr].strat = strat;
+				thread_ctx[thr].size = size;
+			}
+			run_threads(threads, usec, run_reclaim);
+
+			total = 0;
+			for (thr = 0; thr < threads; thr++) {
+				if (!thread_ctx[thr].bytes)
+					break;
+				total += thread_ctx[thr].usec * 1000.0 / thread_ctx[thr].bytes;
+			}
+
+			if (thr < threads)
+				printf("%8s ", "-");
+			else
+				printf("%8.1f ", total / threads);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+}
+
+/*****************************************************************************
+ *                                 legacy tests                              *
+ *****************************************************************************/
+
+void run_bench(unsigned int loop, unsigned int size)
+{
+	unsigned int usecs;
+	struct test_fct *t = test_fcts;
+
+	printf("Running tests with %d loops of %d bytes\n", loop, size);
+
+	while (t->name && t->f) {
+		usecs = t->f(loop, size);
+		printf("%s: %d us for %d loops of %d bytes = %lld kB/s\n",
+		       t->name,
+		       usecs, loop, size, (unsigned long long)1024ULL * loop * size / usecs);
+		t++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int size;
+	unsigned int loop;
+	unsigned int usec;
+	size_t size_max;
+	unsigned int sizes[MAX_ALIGN_SIZES + 1] = { 0 };
+	struct dist_entry dist[MAX_DIST_ENTRIES];
+	const char *dist_name = NULL;
+	int copies = 0;
+	int scans = 0;
+	int zcopy = 0;
+	int reclaim = 0;
+	int threads = 0;
+	int kern = KERN_COPY;
+	int quiet = 0;
+
+	loop = 10;
+	size = 16777216;
+
+	while (argc > 1 && *argv[1] == '-') {
+		if (strcmp(argv[1], "-q") == 0) {
+			quiet = 1;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-a") == 0) {
+			/* -a size[,...] */
+			char *next = argv[2];
+			char *end;
+			int nbs = 0;
+			int sz;
+
+			while (*next && nbs < MAX_ALIGN_SIZES) {
+				sz = strtol(next, &end, 0);
+				if (sz <= 0 || (*end != '\0' && *end != ','))
+					break;
+				sizes[nbs++] = sz;
+				if (*end == ',')
+					end++;
+				next = end;
+			}
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-c") == 0) {
+			copies = 1;
+		}
+		else if (strcmp(argv[1], "-s") == 0) {
+			scans = 1;
+		}
+		else if (strcmp(argv[1], "-z") == 0) {
+			zcopy = 1;
+		}
+		else if (strcmp(argv[1], "-r") == 0) {
+			reclaim = 1;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+			threads = atoi(argv[2]);
+			if (threads <= 0)
+				threads = default_thread_count();
+			if (threads > MAX_THREADS)
+				threads = MAX_THREADS;
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-k") == 0) {
+			if (strcmp(argv[2], "copy") == 0)
+				kern = KERN_COPY;
+			else if (strcmp(argv[2], "set") == 0)
+				kern = KERN_SET;
+			else {
+				for (kern = 0; kern < SCAN_FUNCS; kern++)
+					if (strcmp(argv[2], scan_names[kern]) == 0)
+						break;
+				if (kern == SCAN_FUNCS) {
+					fprintf(stderr, "Unknown kernel '%s'.\n", argv[2]);
+					exit(1);
+				}
+			}
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-d") == 0) {
+			dist_name = argv[2];
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-i") == 0) {
+			/* -i name[,...] */
+			char *next = argv[2];
+			const struct copy_impl *impl;
+			const struct scan_impl *simpl;
+			const struct reclaim_strat *strat;
+			size_t len;
+
+			while (*next) {
+				len = strcspn(next, ",");
+				for (impl = copy_impls; impl->name; impl++)
+					if (strlen(impl->name) == len && strncmp(impl->name, next, len) == 0)
+						break;
+				for (simpl = scan_impls; simpl->name; simpl++)
+					if (strlen(simpl->name) == len && strncmp(simpl->name, next, len) == 0)
+						break;
+				for (strat = reclaim_strats; strat->name; strat++)
+					if (strlen(strat->name) == len && strncmp(strat->name, next, len) == 0)
+						break;
+				if (!impl->name && !simpl->name && !strat->name) {
+					fprintf(stderr, "Unknown implementation '%.*s'.\n", (int)len, next);
+					exit(1);
+				}
+				next += len;
+				if (*next == ',')
+					next++;
+			}
+			impl_list = argv[2];
+			argc--; argv++;
+		}
+		else {
+			fprintf(stderr,
+				"Usage: prog [<loop> [<size> [<unalign>]]]\n"
+				"       prog [options]* [<time_ms> [<size_kB>]]\n"
+				"  -a <sizes>  copy matrix of GB/s per src/dst offset (0..63) at these sizes\n"
+				"              in bytes (1.., ...)\n"
+				"  -c          compare memcpy/memset implementations from %u B to <size_kB>\n"
+				"  -d <dist>   replay random copies following this size distribution over\n"
+				"              <size_kB> pools: rpc, uni, tiny, pow2, or a file of lines\n"
+				"              \"<size>[-<max>] <weight>\"\n"
+				"  -i <impls>  only test these implementations (name, ...)\n"
+				"  -k <kern>   kernel for -t: copy, set, memchr, memrchr, strlen, memcmp or\n"
+				"              findset (copy)\n"
+				"  -q          quiet : don't show column headers\n"
+				"  -r          compare the cost per page of reusing 4 kB to <size_kB> areas\n"
+				"              after memset, stosb, nt, dontneed, free or munmap, on -t\n"
+				"              threads (1)\n"
+				"  -s          check and compare memchr/memrchr/strlen/memcmp and a byte set\n"
+				"              search from 4 kB to <size_kB> at various match densities\n"
+				"  -t <thr>    run the kernel on this many pinned threads with their own\n"
+				"              <size_kB> buffers (0=all CPUs)\n"
+				"  -z          compare memcpy to mremap, vmsplice, process_vm_readv and memfd\n"
+				"              mappings for transfers from 4 kB to <size_kB>\n"
+				"  -h          show this help\n"
+				"Without option, run the legacy tests on <loop> times <size> bytes.\n"
+				"Defaults: time=20ms (1ms with -a, 100ms with -d, -r and -z, 10ms with -s,\n"
+				"          1s with -t), size=twice the largest cache or %u MB (%u kB with\n"
+				"          -d, %u MB with -r and -z, divided by the thread count with -t)\n"
+				"", MIN_SIZE, DEFAULT_SIZE >> 20, DEFAULT_POOL >> 10, DEFAULT_SIZE >> 20);
+			exit(!!strcmp(argv[1], "-h"));
+		}
+		argc--;
+		argv++;
+	}
+
+	if (dist_name) {
+		int nbe = load_dist(dist_name, dist);
+
+		usec = 100000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		size_max = DEFAULT_POOL;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		dist_replay(usec, size_max, dist, nbe, quiet);
+		exit(0);
+	}
+
+	if (*sizes) {
+		usec = 1000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		align_matrix(usec, sizes, quiet);
+		exit(0);
+	}
+
+	if (reclaim) {
+		usec = 100000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		size_max = DEFAULT_SIZE;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		reclaim_sweep(usec, size_max, threads ? threads : 1, quiet);
+		exit(0);
+	}
+
+	if (zcopy) {
+		usec = 100000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		size_max = DEFAULT_SIZE;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		zero_copy(usec, size_max, quiet);
+		exit(0);
+	}
+
+	if (threads) {
+		usec = 1000000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		/* beyond the LLC by default, shared between all threads */
+		size_max = 2 * llc_size();
+		if (!size_max)
+			size_max = DEFAULT_SIZE;
+		size_max /= threads;
+		if (size_max < MIN_THREAD_SIZE)
+			size_max = MIN_THREAD_SIZE;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		thread_scaling(usec, size_max, threads, kern, quiet);
+		exit(0);
+	}
+
+	if (scans) {
+		usec = 10000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		/* beyond the LLC by default */
+		size_max = 2 * llc_size();
+		if (!size_max)
+			size_max = DEFAULT_SIZE;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		scan_suite(usec, size_max, quiet);
+		exit(0);
+	}
+
+	if (copies) {
+		usec = 20000;
+		if (argc > 1)
+			usec = atoi(argv[1]) * 1000;
+
+		/* beyond the LLC by default */
+		size_max = 2 * llc_size();
+		if (!size_max)
+			size_max = DEFAULT_SIZE;
+		if (argc > 2)
+			size_max = (size_t)strtoull(argv[2], NULL, 0) * 1024;
+
+		copy_sweep(usec, size_max, 0, quiet);
+		if (!quiet)
+			printf("\n");
+		copy_sweep(usec, size_max, 1, quiet);
+		exit(0);
+	}
 
 	if (argc > 1)
 		loop = atoi(argv[1]);
@@ -1,10 +1,47 @@
+#ifdef __linux__
+/* for sched_getaffinity() */
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <sys/mman.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+/* largest number of entries supported with 32-bit entries */
+#define MAX_BITS32 32
+
+#define MAX_THREADS 1024
+
+/* page backings of the walked areas */
+#define BACK_4K         0
+#define BACK_THP        1
+#define BACK_HUGETLB    2
+
+#define HUGE_PAGE_SIZE  (2 * 1048576)
 
-#define ENTRIES (1U << 28)
-#define SHIFT   (32 - 28)
-#define MASK    (~0U >> SHIFT)
+/* one walking thread, its own area and its time per round in ns */
+struct walker {
+	void *area;
+	uint64_t *ns;
+	pthread_t pth;
+	int thr;
+	int cpu;
+} __attribute__((aligned(64)));
+
+static struct walker walkers[MAX_THREADS];
+static uint64_t thread_size;   // bytes per thread, power of two
+static int nbthreads = 1;
+static int backing = BACK_4K;
+static int rounds = 1;
+static int bits, wide;
+static int ready_threads;
+static volatile int start_now;
 
 static inline uint32_t rbit32(uint32_t x)
 {
@@ -24,42 +61,348 @@ static inline uint32_t rbit32(uint32_t x)
 	return x;
 }
 
-static void fill_area(uint32_t *area)
+static inline uint64_t rbit64(uint64_t x)
+{
+#ifdef __aarch64__
+	asm volatile("rbit %0, %1\n" : "=r"(x) : "r"(x));
+#else
+#if defined(__x86_64__)
+	__asm__("bswap %0" : "=r"(x) : "0"(x));
+#else
+	x = ((x & 0xffffffff00000000) >> 32) | ((x & 0x00000000ffffffff) << 32);
+	x = ((x & 0xffff0000ffff0000) >> 16) | ((x & 0x0000ffff0000ffff) << 16);
+	x = ((x & 0xff00ff00ff00ff00) >>  8) | ((x & 0x00ff00ff00ff00ff) <<  8);
+#endif
+	x = ((x & 0xf0f0f0f0f0f0f0f0) >>  4) | ((x & 0x0f0f0f0f0f0f0f0f) <<  4);
+	x = ((x & 0xcccccccccccccccc) >>  2) | ((x & 0x3333333333333333) <<  2);
+	x = ((x & 0xaaaaaaaaaaaaaaaa) >>  1) | ((x & 0x5555555555555555) <<  1);
+#endif
+	return x;
+}
+
+/* fills the 2^<bits> entries of <area> so that each of them contains the index
+ * of the next one in bit-reversed order. Entries are 32-bit so <bits> may not
+ * be larger than 32.
+ */
+static void fill_area32(uint32_t *area, int bits)
 {
-	uint32_t addr;
+	uint64_t addr, entries = 1ULL << bits;
+	int shift = 32 - bits;
 
-	for (addr = 0; addr < ENTRIES; addr++) {
-		area[addr] = rbit32((rbit32(addr << SHIFT) + 1) << SHIFT);
+	for (addr = 0; addr < entries; addr++) {
+		area[addr] = rbit32((rbit32((uint32_t)addr << shift) + 1) << shift);
 	}
 }
 
-static void scan_area(const uint32_t *area, int rounds)
+/* same as above with 64-bit entries, for areas too large for 32-bit indexes */
+static void fill_area64(uint64_t *area, int bits)
 {
-	uint32_t next, ent;
+	uint64_t addr, entries = 1ULL << bits;
+	int shift = 64 - bits;
 
-	while (rounds--) {
-		next = 0;
-		for (ent = next = 0; ent < ENTRIES; ent++)
-			next = area[next];
-		asm("" :: "r"(next));
+	for (addr = 0; addr < entries; addr++) {
+		area[addr] = rbit64((rbit64(addr << shift) + 1) << shift);
 	}
 }
 
+/* walks the whole chain once */
+static void scan_area32(const uint32_t *area, int bits)
+{
+	uint64_t ent, entries = 1ULL << bits;
+	uint32_t next;
+
+	for (ent = next = 0; ent < entries; ent++)
+		next = area[next];
+	asm("" :: "r"(next));
+}
+
+static void scan_area64(const uint64_t *area, int bits)
+{
+	uint64_t ent, next, entries = 1ULL << bits;
+
+	for (ent = next = 0; ent < entries; ent++)
+		next = area[next];
+	asm("" :: "r"(next));
+}
+
+/* returns a timestamp in nanoseconds */
+static inline uint64_t now_ns()
+{
+	struct timespec tv;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+	return tv.tv_sec * 1000000000ULL + tv.tv_nsec;
+}
+
+/* return the default thread count based on the detected affinity settings. */
+static int default_thread_count()
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+		return CPU_COUNT(&mask);
+#endif
+	return 1;
+}
+
+/* Returns the <n>th CPU modulo the number of CPUs the process may run on, or
+ * -1 if unknown.
+ */
+static int nth_cpu(int n)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) != 0 || !CPU_COUNT(&mask))
+		return -1;
+
+	n %= CPU_COUNT(&mask);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &mask) && n-- == 0)
+			return cpu;
+#endif
+	return -1;
+}
+
+/* binds the calling thread to CPU <cpu> unless negative */
+static void bind_to_cpu(int cpu)
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+	cpu_set_t mask;
+
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+
+/* Maps <size> bytes backed by pages of type <backing>. THP areas are aligned
+ * to the huge page size. Returns NULL on failure.
+ */
+static void *alloc_area(size_t size, int backing)
+{
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	char *area, *aligned;
+
+	if (backing == BACK_HUGETLB) {
+#ifdef MAP_HUGETLB
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		return area == MAP_FAILED ? NULL : area;
+#else
+		return NULL;
+#endif
+	}
+
+	if (backing == BACK_4K) {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (area == MAP_FAILED)
+			return NULL;
+#ifdef MADV_NOHUGEPAGE
+		madvise(area, size, MADV_NOHUGEPAGE);
+#endif
+		return area;
+	}
+
+	area = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (area == MAP_FAILED)
+		return NULL;
+
+	aligned = (char *)(((uintptr_t)area + HUGE_PAGE_SIZE - 1) & -(uintptr_t)HUGE_PAGE_SIZE);
+	if (aligned > area)
+		munmap(area, aligned - area);
+	munmap(aligned + size, area + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+/* Binds the thread to its CPU, allocates and fills its own chain so that it
+ * lands on its NUMA node, then once all threads are ready, walks the chain
+ * <rounds> times, storing the duration of each round.
+ */
+static void *run_walker(void *private)
+{
+	struct walker *ctx = private;
+	uint64_t before;
+	int round;
+
+	bind_to_cpu(ctx->cpu);
+
+	ctx->area = alloc_area(thread_size, backing);
+	if (!ctx->area) {
+		printf("Failed to allocate memory\n");
+		exit(1);
+	}
+
+	if (wide)
+		fill_area64(ctx->area, bits);
+	else
+		fill_area32(ctx->area, bits);
+
+	__atomic_add_fetch(&ready_threads, 1, __ATOMIC_SEQ_CST);
+	while (!start_now)
+		;
+
+	for (round = 0; round < rounds; round++) {
+		before = now_ns();
+		if (wide)
+			scan_area64(ctx->area, bits);
+		else
+			scan_area32(ctx->area, bits);
+		ctx->ns[round] = now_ns() - before;
+	}
+
+	munmap(ctx->area, thread_size);
+	return NULL;
+}
+
 int main(int argc, char **argv)
 {
-	int rounds = 1;
-	void *area;
+	static const char *const back_names[] = { "4k", "THP", "hugetlb" };
+	uint64_t size = 1ULL << 30;
+	uint64_t entries, total_ns;
+	double steps;
+	int thr, round;
+	int quiet = 0;
+
+	while (argc > 1 && *argv[1] == '-') {
+		if (strcmp(argv[1], "-q") == 0) {
+			quiet = 1;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+			nbthreads = atoi(argv[2]);
+			if (nbthreads <= 0)
+				nbthreads = default_thread_count();
+			argc--; argv++;
+		}
+		else if (argc > 2 && strcmp(argv[1], "-p") == 0) {
+			if (strcmp(argv[2], "4k") == 0)
+				backing = BACK_4K;
+			else if (strcmp(argv[2], "thp") == 0)
+				backing = BACK_THP;
+			else if (strcmp(argv[2], "hugetlb") == 0)
+				backing = BACK_HUGETLB;
+			else {
+				fprintf(stderr, "Unknown page backing '%s'.\n", argv[2]);
+				exit(1);
+			}
+			argc--; argv++;
+		}
+		else {
+			fprintf(stderr,
+				"Usage: prog [options]* [<rounds> [<size_MB>]]\n"
+				"  -t <threads> : walk <size_MB>/<threads> per thread, each bound to its own\n"
+				"                 CPU (0=all CPUs, default: 1)\n"
+				"  -p <pages>   : page backing: 4k, thp or hugetlb (default: 4k)\n"
+				"  -q           : quiet : only show the summary\n"
+				"  -h           : show this help\n"
+				"Defaults: rounds=1, size=1024 MB\n");
+			exit(!!strcmp(argv[1], "-h"));
+		}
+		argc--;
+		argv++;
+	}
 
 	if (argc > 1)
 		rounds = atoi(argv[1]);
 
-	printf("malloc 1 GB...\n");
-	area = calloc(1, ENTRIES * 4);
-	if (!area)
+	if (argc > 2)
+		size = strtoull(argv[2], NULL, 0) << 20;
+
+	if (nbthreads < 1 || nbthreads > MAX_THREADS) {
+		fprintf(stderr, "Fatal: invalid number of threads, accepted range is 1..%d.\n", MAX_THREADS);
+		exit(1);
+	}
+
+	if (rounds < 1)
+		rounds = 1;
+
+	/* round it down to the largest power of 2 */
+	thread_size = size / nbthreads;
+	while (thread_size & (thread_size - 1))
+		thread_size &= thread_size - 1;
+
+	if (thread_size < 4096 || thread_size != (size_t)thread_size) {
+		fprintf(stderr, "Fatal: invalid size, minimum is 4kB per thread.\n");
+		return 1;
+	}
+
+	if (backing == BACK_HUGETLB && thread_size < HUGE_PAGE_SIZE) {
+		fprintf(stderr, "Fatal: hugetlb needs at least %u kB per thread.\n", HUGE_PAGE_SIZE >> 10);
 		return 1;
-	printf("fill...\n");
-	fill_area(area);
-	printf("scan %d times...\n", rounds);
-	scan_area(area, rounds);
+	}
+
+	/* 32-bit entries cover up to 16 GB, use 64-bit ones above */
+	for (bits = 0; thread_size >> bits > 4; bits++)
+		;
+	wide = bits > MAX_BITS32;
+	if (wide)
+		bits--;
+	entries = 1ULL << bits;
+
+	if (!quiet)
+		printf("filling %llu MB with %s pages on %d threads...\n",
+		       (unsigned long long)(thread_size * nbthreads >> 20), back_names[backing], nbthreads);
+
+	for (thr = 0; thr < nbthreads; thr++) {
+		walkers[thr].thr = thr;
+		walkers[thr].cpu = nth_cpu(thr);
+		walkers[thr].ns = calloc(rounds, sizeof(*walkers[thr].ns));
+		if (!walkers[thr].ns) {
+			printf("Failed to allocate memory\n");
+			exit(1);
+		}
+		if (pthread_create(&walkers[thr].pth, NULL, run_walker, &walkers[thr]) != 0) {
+			fprintf(stderr, "Failed to start thread #%d; aborting.\n", thr);
+			exit(1);
+		}
+	}
+
+	while (__atomic_load_n(&ready_threads, __ATOMIC_ACQUIRE) != nbthreads)
+		usleep(1000);
+
+	if (!quiet)
+		printf("walking %llu steps per thread %d times...\n", (unsigned long long)entries, rounds);
+
+	start_now = 1;
+	for (thr = 0; thr < nbthreads; thr++)
+		pthread_join(walkers[thr].pth, NULL);
+
+	/* per round: ns/step of each thread, then aggregate Msteps/s */
+	if (!quiet) {
+		printf(" round:");
+		for (thr = 0; thr < nbthreads; thr++)
+			printf(" %7d", thr);
+		printf(" %9s\n", "Msteps/s");
+
+		for (round = 0; round < rounds; round++) {
+			printf("%6d:", round + 1);
+			steps = 0;
+			for (thr = 0; thr < nbthreads; thr++) {
+				printf(" %7.2f", (double)walkers[thr].ns[round] / entries);
+				steps += entries * 1000.0 / walkers[thr].ns[round];
+			}
+			printf(" %9.2f\n", steps);
+		}
+	}
+
+	/* per thread: average ns/step and steps/s over all rounds */
+	steps = 0;
+	for (thr = 0; thr < nbthreads; thr++) {
+		for (total_ns = round = 0; round < rounds; round++)
+			total_ns += walkers[thr].ns[round];
+		steps += entries * rounds * 1000.0 / total_ns;
+		if (!quiet)
+			printf("thread %d (cpu %d): %.2f ns/step, %.2f Msteps/s\n", thr, walkers[thr].cpu,
+			       (double)total_ns / rounds / entries, entries * rounds * 1000.0 / total_ns);
+		free(walkers[thr].ns);
+	}
+	printf("total: %.2f Msteps/s, %.2f ns/step\n", steps, nbthreads * 1000.0 / steps);
 	return 0;
 }